@@ -0,0 +1,487 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <ctype.h>
+#include <iostream>
+
+#include "BandcampCollection.h"
+#include "RunStats.h"
+#include "Utilities.h"
+
+using std::char_traits;
+using std::ifstream;
+using std::ios;
+using std::streambuf;
+using std::streampos;
+using std::string;
+using std::vector;
+
+static bool read_hex_digits(streambuf *pInput, unsigned int &value)
+{
+	value = 0;
+
+	for (unsigned int digitNum = 0; digitNum < 4; ++digitNum)
+	{
+		int c = pInput->sbumpc();
+
+		value <<= 4;
+		if ((c >= '0') && (c <= '9'))
+		{
+			value += (unsigned int)(c - '0');
+		}
+		else if ((c >= 'a') && (c <= 'f'))
+		{
+			value += (unsigned int)(c - 'a' + 10);
+		}
+		else if ((c >= 'A') && (c <= 'F'))
+		{
+			value += (unsigned int)(c - 'A' + 10);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+BandcampItem::BandcampItem()
+{
+}
+
+BandcampItem::BandcampItem(const BandcampItem &other) :
+	m_bandName(other.m_bandName),
+	m_albumTitle(other.m_albumTitle),
+	m_purchased(other.m_purchased),
+	m_itemArtUrl(other.m_itemArtUrl)
+{
+}
+
+BandcampItem::~BandcampItem()
+{
+}
+
+BandcampItem &BandcampItem::operator=(const BandcampItem &other)
+{
+	if (this != &other)
+	{
+		m_bandName = other.m_bandName;
+		m_albumTitle = other.m_albumTitle;
+		m_purchased = other.m_purchased;
+		m_itemArtUrl = other.m_itemArtUrl;
+	}
+
+	return *this;
+}
+
+BandcampCollection::BandcampCollection() :
+	m_parseError(false),
+	m_moreAvailable(false),
+	m_hasItems(false),
+	m_pInput(NULL),
+	m_scalarIsString(false)
+{
+}
+
+BandcampCollection::~BandcampCollection()
+{
+}
+
+bool BandcampCollection::load(const string &fileName)
+{
+	ifstream inputFile;
+
+	m_parseError = m_moreAvailable = m_hasItems = false;
+	m_items.clear();
+
+	inputFile.open(fileName.c_str(), ios::in | ios::binary);
+	if (inputFile.good() == false)
+	{
+		return false;
+	}
+
+	m_pInput = inputFile.rdbuf();
+
+	// Is there anything in there at all?
+	if (m_pInput->sgetc() == char_traits<char>::eof())
+	{
+		m_pInput = NULL;
+
+		return false;
+	}
+
+	PhaseTimer collectionTimer("collection");
+
+	// The file is read as it's scanned, without holding it all in memory
+	if (scan_value(0, SCAN_ROOT, NULL) == false)
+	{
+		m_parseError = true;
+		m_moreAvailable = m_hasItems = false;
+		m_items.clear();
+	}
+	m_pInput = NULL;
+
+	streampos readLength = inputFile.tellg();
+	if (readLength > 0)
+	{
+		RunStats::add_count("bytes_read", (unsigned long long)readLength);
+	}
+
+	return true;
+}
+
+int BandcampCollection::next_char(void)
+{
+	int c = m_pInput->sgetc();
+
+	// Skip white space, the character itself isn't consumed
+	while ((c == ' ') ||
+		(c == '\t') ||
+		(c == '\n') ||
+		(c == '\r'))
+	{
+		c = m_pInput->snextc();
+	}
+
+	return c;
+}
+
+bool BandcampCollection::expect_char(int expectedChar)
+{
+	if (next_char() != expectedChar)
+	{
+		return false;
+	}
+
+	m_pInput->sbumpc();
+
+	return true;
+}
+
+bool BandcampCollection::scan_value(unsigned int depth,
+	ScanContext context, string *pValue)
+{
+	int c = next_char();
+
+	if (pValue != NULL)
+	{
+		pValue->clear();
+	}
+	m_scalarIsString = false;
+
+	if (c == '{')
+	{
+		if ((context == SCAN_ITEM) ||
+			(context == SCAN_ROOT))
+		{
+			if (context == SCAN_ITEM)
+			{
+				m_items.push_back(BandcampItem());
+			}
+
+			return scan_object(depth + 1, context);
+		}
+
+		return scan_object(depth + 1, SCAN_OTHER);
+	}
+	else if (c == '[')
+	{
+		if (context == SCAN_ITEMS)
+		{
+			// If there's more than one list of items, the last one wins
+			m_hasItems = true;
+			m_items.clear();
+
+			return scan_array(depth + 1, SCAN_ITEMS);
+		}
+
+		return scan_array(depth + 1, SCAN_OTHER);
+	}
+	else if (context == SCAN_ITEMS)
+	{
+		m_hasItems = false;
+		m_items.clear();
+	}
+
+	if (c == '"')
+	{
+		m_scalarIsString = true;
+
+		return scan_string(pValue);
+	}
+
+	return scan_literal(pValue);
+}
+
+bool BandcampCollection::scan_object(unsigned int depth,
+	ScanContext context)
+{
+	if (depth > m_maxDepth)
+	{
+		return false;
+	}
+
+	// Skip the opening brace
+	m_pInput->sbumpc();
+
+	if (expect_char('}') == true)
+	{
+		return true;
+	}
+
+	while (true)
+	{
+		string key, moreAvailable;
+		ScanContext valueContext = SCAN_OTHER;
+		string *pValue = NULL;
+
+		if ((next_char() != '"') ||
+			(scan_string(&key) == false) ||
+			(expect_char(':') == false))
+		{
+			return false;
+		}
+
+		if (context == SCAN_ROOT)
+		{
+			if (key == "items")
+			{
+				valueContext = SCAN_ITEMS;
+			}
+			else if (key == "more_available")
+			{
+				pValue = &moreAvailable;
+			}
+		}
+		else if (context == SCAN_ITEM)
+		{
+			BandcampItem &item = m_items.back();
+
+			// Only keep these
+			if (key == "band_name")
+			{
+				pValue = &item.m_bandName;
+			}
+			else if (key == "album_title")
+			{
+				pValue = &item.m_albumTitle;
+			}
+			else if (key == "purchased")
+			{
+				pValue = &item.m_purchased;
+			}
+			else if (key == "item_art_url")
+			{
+				pValue = &item.m_itemArtUrl;
+			}
+		}
+
+		if (scan_value(depth, valueContext, pValue) == false)
+		{
+			return false;
+		}
+
+		if (pValue == &moreAvailable)
+		{
+			// Only a boolean counts
+			m_moreAvailable = ((m_scalarIsString == false) && (moreAvailable == "true"));
+		}
+
+		if (expect_char(',') == true)
+		{
+			continue;
+		}
+
+		return expect_char('}');
+	}
+}
+
+bool BandcampCollection::scan_array(unsigned int depth,
+	ScanContext context)
+{
+	if (depth > m_maxDepth)
+	{
+		return false;
+	}
+
+	// Skip the opening bracket
+	m_pInput->sbumpc();
+
+	if (expect_char(']') == true)
+	{
+		return true;
+	}
+
+	while (true)
+	{
+		// Elements of the list of items that aren't objects are skipped
+		if (scan_value(depth, (context == SCAN_ITEMS ? SCAN_ITEM : SCAN_OTHER), NULL) == false)
+		{
+			return false;
+		}
+
+		if (expect_char(',') == true)
+		{
+			continue;
+		}
+
+		return expect_char(']');
+	}
+}
+
+bool BandcampCollection::scan_string(string *pValue)
+{
+	// Skip the opening quote
+	m_pInput->sbumpc();
+
+	int c = m_pInput->sbumpc();
+	while (c != '"')
+	{
+		if (c == char_traits<char>::eof())
+		{
+			return false;
+		}
+		else if (c == '\\')
+		{
+			c = m_pInput->sbumpc();
+
+			switch (c)
+			{
+				case '"':
+				case '\\':
+				case '/':
+					break;
+				case 'b':
+					c = '\b';
+					break;
+				case 'f':
+					c = '\f';
+					break;
+				case 'n':
+					c = '\n';
+					break;
+				case 'r':
+					c = '\r';
+					break;
+				case 't':
+					c = '\t';
+					break;
+				case 'u':
+				{
+					unsigned int codePoint = 0;
+
+					if (scan_code_point(codePoint) == false)
+					{
+						return false;
+					}
+					if (pValue != NULL)
+					{
+						append_utf8(codePoint, *pValue);
+					}
+
+					c = m_pInput->sbumpc();
+					continue;
+				}
+				default:
+					return false;
+			}
+		}
+
+		if (pValue != NULL)
+		{
+			*pValue += (char)c;
+		}
+
+		c = m_pInput->sbumpc();
+	}
+
+	return true;
+}
+
+bool BandcampCollection::scan_literal(string *pValue)
+{
+	string literal;
+
+	int c = m_pInput->sgetc();
+	while ((c != char_traits<char>::eof()) &&
+		((isalnum(c) != 0) ||
+		(c == '+') ||
+		(c == '-') ||
+		(c == '.')))
+	{
+		literal += (char)c;
+
+		c = m_pInput->snextc();
+	}
+
+	if (literal.empty() == true)
+	{
+		return false;
+	}
+	else if (literal == "null")
+	{
+		// Same as an empty string
+		return true;
+	}
+	else if ((literal != "true") &&
+		(literal != "false") &&
+		(literal[0] != '-') &&
+		(isdigit(literal[0]) == 0))
+	{
+		return false;
+	}
+
+	if (pValue != NULL)
+	{
+		*pValue = literal;
+	}
+
+	return true;
+}
+
+bool BandcampCollection::scan_code_point(unsigned int &codePoint)
+{
+	if (read_hex_digits(m_pInput, codePoint) == false)
+	{
+		return false;
+	}
+
+	// A high surrogate must be followed by a low surrogate. Like jsoncpp,
+	// a lone low surrogate is let through and encoded as is
+	if ((codePoint >= 0xD800) &&
+		(codePoint <= 0xDBFF))
+	{
+		unsigned int lowSurrogate = 0;
+
+		if ((m_pInput->sbumpc() != '\\') ||
+			(m_pInput->sbumpc() != 'u') ||
+			(read_hex_digits(m_pInput, lowSurrogate) == false) ||
+			(lowSurrogate < 0xDC00) ||
+			(lowSurrogate > 0xDFFF))
+		{
+			return false;
+		}
+
+		codePoint = 0x10000 + ((codePoint & 0x3FF) << 10) + (lowSurrogate & 0x3FF);
+	}
+
+	return true;
+}
+
+unsigned int BandcampCollection::m_maxDepth = 1000;
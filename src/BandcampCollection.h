@@ -0,0 +1,89 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _BANDCAMP_COLLECTION_H
+#define _BANDCAMP_COLLECTION_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+class BandcampItem
+{
+	public:
+		BandcampItem();
+		BandcampItem(const BandcampItem &other);
+		virtual ~BandcampItem();
+
+		BandcampItem &operator=(const BandcampItem &other);
+
+		std::string m_bandName;
+		std::string m_albumTitle;
+		std::string m_purchased;
+		std::string m_itemArtUrl;
+
+};
+
+// Scans a collection_items.json file and only keeps what's needed of each item
+class BandcampCollection
+{
+	public:
+		BandcampCollection();
+		virtual ~BandcampCollection();
+
+		bool load(const std::string &fileName);
+
+		bool m_parseError;
+		bool m_moreAvailable;
+		bool m_hasItems;
+		std::vector<BandcampItem> m_items;
+
+		static unsigned int m_maxDepth;
+
+	protected:
+		typedef enum { SCAN_OTHER = 0, SCAN_ROOT, SCAN_ITEMS, SCAN_ITEM } ScanContext;
+
+		std::streambuf *m_pInput;
+		bool m_scalarIsString;
+
+		int next_char(void);
+
+		bool expect_char(int expectedChar);
+
+		bool scan_value(unsigned int depth,
+			ScanContext context, std::string *pValue);
+
+		bool scan_object(unsigned int depth,
+			ScanContext context);
+
+		bool scan_array(unsigned int depth,
+			ScanContext context);
+
+		bool scan_string(std::string *pValue);
+
+		bool scan_literal(std::string *pValue);
+
+		bool scan_code_point(unsigned int &codePoint);
+
+	private:
+		BandcampCollection(const BandcampCollection &other);
+		BandcampCollection &operator=(const BandcampCollection &other);
+
+};
+
+#endif // _BANDCAMP_COLLECTION_H
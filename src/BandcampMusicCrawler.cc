@@ -29,24 +29,43 @@
 #include <iostream>
 #include <map>
 #include <fstream>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "BandcampMusicCrawler.h"
+#include "Logger.h"
+#include "RunStats.h"
 #include "Utilities.h"
 
-using std::clog;
 using std::endl;
+using std::find;
 using std::for_each;
+using std::less;
 using std::map;
 using std::ofstream;
 using std::pair;
+using std::set;
 using std::sort;
 using std::string;
 using std::stringstream;
 using std::vector;
 
+static void parse_purchase_date(const string &purchaseDate,
+	struct tm &timeTm)
+{
+	// Initialize the structure
+	timeTm.tm_sec = timeTm.tm_min = timeTm.tm_hour = timeTm.tm_mday = 0;
+	timeTm.tm_mon = timeTm.tm_year = timeTm.tm_wday = timeTm.tm_yday = timeTm.tm_isdst = 0;
+
+#ifdef HAVE_STRPTIME
+	strptime(purchaseDate.c_str(), "%d %b %Y %H:%M:%S %Z", &timeTm);
+#else
+	// FIXME: parse the date
+#endif
+}
+
 BandcampAlbum::BandcampAlbum(const string &artist,
 	const string &album) :
 	m_artist(artist),
@@ -92,34 +111,42 @@ bool BandcampAlbum::operator<(const BandcampAlbum &other) const
 	return false;
 }
 
+bool BandcampAlbum::operator==(const BandcampAlbum &other) const
+{
+	return ((m_artist == other.m_artist) &&
+		(m_album == other.m_album));
+}
+
 string BandcampAlbum::to_key(void) const
 {
 	return m_artist + " - " + m_album;
 }
 
 BandcampMusicCrawler::BandcampMusicCrawler(const string &topLevelDirName,
-	const char *pCollection) :
+	const BandcampCollection &collection) :
 	MusicFolderCrawler(topLevelDirName),
-	m_parseError(false)
+	m_collection(collection),
+	m_pathAlbums(less<string>(), PathAlbums::allocator_type(get_maps_arena())),
+	m_purchasedTracks(less<int>(), YearPlaylists::allocator_type(get_maps_arena())),
+	m_artistAlbums(less<string>(), ArtistAlbums::allocator_type(get_maps_arena())),
+	m_parseError(collection.m_parseError)
 {
-	Json::Reader reader;
-
-	if (reader.parse(pCollection, m_bandcampObject) == false)
-	{
-		m_parseError = true;
-	}
 }
 
 BandcampMusicCrawler::BandcampMusicCrawler(const string &topLevelDirName,
-	const char *pCollection,
-	const char *pLookup) :
+	const BandcampCollection &collection,
+	const char *pLookup, off_t lookupLength) :
 	MusicFolderCrawler(topLevelDirName),
-	m_parseError(false)
+	m_collection(collection),
+	m_pathAlbums(less<string>(), PathAlbums::allocator_type(get_maps_arena())),
+	m_purchasedTracks(less<int>(), YearPlaylists::allocator_type(get_maps_arena())),
+	m_artistAlbums(less<string>(), ArtistAlbums::allocator_type(get_maps_arena())),
+	m_parseError(collection.m_parseError)
 {
 	Json::Reader reader;
 
-	if ((reader.parse(pCollection, m_bandcampObject) == false) ||
-		(reader.parse(pLookup, m_lookupObject) == false))
+	// The lookup file may not be NUL-terminated
+	if (reader.parse(pLookup, pLookup + lookupLength, m_lookupObject) == false)
 	{
 		m_parseError = true;
 	}
@@ -131,8 +158,8 @@ BandcampMusicCrawler::~BandcampMusicCrawler()
 
 	if (m_purchasedTracks.empty() == false)
 	{
-		// Write playlists and free lists up
-		dump_and_delete_tracks(m_purchasedTracks, "Bandcamp ");
+		// Write playlists
+		dump_playlists(m_purchasedTracks, "Bandcamp ");
 	}
 }
 
@@ -140,69 +167,104 @@ void BandcampMusicCrawler::crawl(void)
 {
 	if (m_parseError == true)
 	{
-		clog << "Failed to parse collection" << endl;
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to parse collection";
 		return;
 	}
 
-	if (m_bandcampObject["more_available"].isBool() == true &&
-		m_bandcampObject["more_available"].asBool() == true)
+	if (m_collection.m_moreAvailable == true)
 	{
-		clog << "Collection is incomplete, adjust older_than_token and/or count" << endl;
+		LogMessage(LOG_LEVEL_WARNING) << "Collection is incomplete, adjust older_than_token and/or count";
 		return;
 	}
 
-	if ((m_bandcampObject["items"].isArray() == false) ||
-		(m_bandcampObject["items"].empty() == true))
+	if ((m_collection.m_hasItems == false) ||
+		(m_collection.m_items.empty() == true))
 	{
-		clog << "Collection is empty" << endl;
+		LogMessage(LOG_LEVEL_WARNING) << "Collection is empty";
 		return;
 	}
 
-	unsigned int artistCount = 0;
-
 	// Now go through the music collection
 	MusicFolderCrawler::crawl();
 
 	// Load the contents of the lookup file
 	load_lookup_file();
 
-	// Try and match Bandcamp artists and albums to those found in the music collection
-	for (Json::ArrayIndex itemIndex = 0;
-		itemIndex < m_bandcampObject["items"].size(); ++itemIndex)
+	PhaseTimer matchTimer("match");
+	unsigned int artistCount = match_purchases(NULL);
+	matchTimer.stop();
+
+	LogMessage(LOG_LEVEL_INFO) << "Found " << artistCount << " Bandcamp artist(s), across " << m_yearTracks.size() << " year(s)";
+}
+
+void BandcampMusicCrawler::record_album_artist(const string &entryName,
+	const string &artist, const string &album)
+{
+	BandcampAlbum thisAlbum(artist, album);
+
+	MusicFolderCrawler::record_album_artist(entryName, artist, album);
+
+	m_pathAlbums.insert(pair<string, BandcampAlbum>(entryName, thisAlbum));
+
+	ArtistPlaylists::const_iterator artistIter = m_artistTracks.find(artist);
+
+	if ((artistIter == m_artistTracks.end()) ||
+		(artistIter->second.m_trackIndices.empty() == true))
 	{
-		Json::Value bandcampItem(m_bandcampObject["items"].get(itemIndex, Json::objectValue));
+		return;
+	}
 
-		if (bandcampItem.isObject() == false)
-		{
-			continue;
-		}
+	// Index the track that was just added to the artist's playlist by album
+	// Unlike the album given here, an empty album isn't replaced
+	unsigned int trackIndex = artistIter->second.m_trackIndices.back();
+	string albumKey(fold_case(m_tracks[trackIndex].get_album()));
+
+	ArtistAlbums::iterator albumsIter = m_artistAlbums.find(artist);
+
+	if (albumsIter == m_artistAlbums.end())
+	{
+		// The arena allocator can't be default constructed
+		albumsIter = m_artistAlbums.insert(pair<string, AlbumTracks>(artist,
+			AlbumTracks(less<string>(), AlbumTracks::allocator_type(get_maps_arena())))).first;
+	}
+
+	albumsIter->second[albumKey].push_back(trackIndex);
+}
+
+unsigned int BandcampMusicCrawler::match_purchases(const set<int> *pYears)
+{
+	unsigned int artistCount = 0;
 
-		string bandName(to_lower_case(bandcampItem["band_name"].asString()));
-		string albumTitle(to_lower_case(bandcampItem["album_title"].asString()));
+	// Try and match Bandcamp artists and albums to those found in the music collection
+	for (vector<BandcampItem>::const_iterator itemIter = m_collection.m_items.begin();
+		itemIter != m_collection.m_items.end(); ++itemIter)
+	{
+		string bandName(fold_case(itemIter->m_bandName));
+		string albumTitle(fold_case(itemIter->m_albumTitle));
 		BandcampAlbum thisAlbum(bandName, albumTitle);
-		string purchaseDate(bandcampItem["purchased"].asString());
-		string albumArtUrl(bandcampItem["item_art_url"].asString());
+		const string &albumArtUrl = itemIter->m_itemArtUrl;
 		struct tm timeTm;
 		char timeStr[32];
 
-		// Initialize the structure
-		timeTm.tm_sec = timeTm.tm_min = timeTm.tm_hour = timeTm.tm_mday = 0;
-		timeTm.tm_mon = timeTm.tm_year = timeTm.tm_wday = timeTm.tm_yday = timeTm.tm_isdst = 0;
+		parse_purchase_date(itemIter->m_purchased, timeTm);
 
-#ifdef HAVE_STRPTIME
-		strptime(purchaseDate.c_str(), "%d %b %Y %H:%M:%S %Z", &timeTm);
-#else
-		// FIXME: parse the date
-#endif
 		int year = 1900 + timeTm.tm_year;
 		int month = 1 + timeTm.tm_mon;
+
+		// Only match purchases made these years
+		if ((pYears != NULL) &&
+			(pYears->find(year) == pYears->end()))
+		{
+			continue;
+		}
+
 		size_t strSize = strftime(timeStr, 32, "%s", &timeTm);
 
-		map<string, vector<Track>*>::iterator artistIter = m_artistTracks.find(thisAlbum.m_artist);
+		ArtistPlaylists::const_iterator artistIter = m_artistTracks.find(thisAlbum.m_artist);
 
 		if (artistIter == m_artistTracks.end())
 		{
-			clog << "No tracks for artist " << thisAlbum.m_artist << " " << thisAlbum.m_album << endl;
+			Logger::problem(PROBLEM_NO_ARTIST_TRACKS, thisAlbum.m_artist + " " + thisAlbum.m_album);
 
 			if (resolve_missing_album(thisAlbum) == false)
 			{
@@ -214,20 +276,18 @@ void BandcampMusicCrawler::crawl(void)
 
 			if (artistIter == m_artistTracks.end())
 			{
-				clog << "No tracks for artist " << thisAlbum.m_artist << " " << thisAlbum.m_album << endl;
+				Logger::problem(PROBLEM_NO_ARTIST_TRACKS, thisAlbum.m_artist + " " + thisAlbum.m_album);
 				continue;
 			}
 		}
 		++artistCount;
 
-		const vector<Track> *pTracks = artistIter->second;
-		// FIXME: optimize for speed and keep track of albums?
-		unsigned int albumTrackCount = find_album_tracks(pTracks,
-			thisAlbum, albumArtUrl, year, timeStr, strSize);
+		unsigned int albumTrackCount = find_album_tracks(thisAlbum,
+			albumArtUrl, year, timeStr, strSize);
 
 		if (albumTrackCount == 0)
 		{
-			clog << "No tracks for album " << thisAlbum.m_artist << " " << thisAlbum.m_album << endl;
+			Logger::problem(PROBLEM_NO_ALBUM_TRACKS, thisAlbum.m_artist + " " + thisAlbum.m_album);
 
 			if (resolve_missing_album(thisAlbum) == false)
 			{
@@ -235,50 +295,158 @@ void BandcampMusicCrawler::crawl(void)
 			}
 
 			// Load that album's tracks
-			albumTrackCount = find_album_tracks(pTracks,
-				thisAlbum, albumArtUrl, year, timeStr, strSize);
+			albumTrackCount = find_album_tracks(thisAlbum,
+				albumArtUrl, year, timeStr, strSize);
 		}
 
-		clog << "Bandcamp album " << thisAlbum.m_artist << " - " << thisAlbum.m_album
-			<< " purchased " << month << "/" << year << " has " << albumTrackCount << " tracks" << endl;
+		LogMessage(LOG_LEVEL_DEBUG) << "Bandcamp album " << thisAlbum.m_artist << " - " << thisAlbum.m_album
+			<< " purchased " << month << "/" << year << " has " << albumTrackCount << " tracks";
 	}
 
-	clog << "Found " << artistCount << " Bandcamp artist(s), across " << m_yearTracks.size() << " year(s)" << endl;
+	return artistCount;
 }
 
-void BandcampMusicCrawler::record_album_artist(const string &entryName,
-	const string &artist, const string &album)
+void BandcampMusicCrawler::write_playlists(const PlaylistChanges *pChanges)
 {
-	BandcampAlbum thisAlbum(artist, album);
+	if (pChanges == NULL)
+	{
+		dump_playlists(m_purchasedTracks, "Bandcamp ");
+	}
+	else if (pChanges->m_artists.empty() == false)
+	{
+		set<int> purchaseYears;
 
-	MusicFolderCrawler::record_album_artist(entryName, artist, album);
+		// Purchases by artists whose tracks changed are matched again, a year at a time
+		for (vector<BandcampItem>::const_iterator itemIter = m_collection.m_items.begin();
+			itemIter != m_collection.m_items.end(); ++itemIter)
+		{
+			BandcampAlbum thisAlbum(fold_case(itemIter->m_bandName),
+				fold_case(itemIter->m_albumTitle));
+			map<string, BandcampAlbum>::const_iterator albumIter = m_resolvedAlbums.find(thisAlbum.to_key());
 
-	m_pathAlbums.insert(pair<string, BandcampAlbum>(entryName, thisAlbum));
+			if ((pChanges->m_artists.find(thisAlbum.m_artist) != pChanges->m_artists.end()) ||
+				((albumIter != m_resolvedAlbums.end()) &&
+				(pChanges->m_artists.find(albumIter->second.m_artist) != pChanges->m_artists.end())))
+			{
+				struct tm timeTm;
+
+				parse_purchase_date(itemIter->m_purchased, timeTm);
+
+				purchaseYears.insert(1900 + timeTm.tm_year);
+			}
+		}
+
+		for (set<int>::const_iterator yearIter = purchaseYears.begin();
+			yearIter != purchaseYears.end(); ++yearIter)
+		{
+			YearPlaylists::iterator playlistIter = m_purchasedTracks.find(*yearIter);
+
+			if (playlistIter == m_purchasedTracks.end())
+			{
+				continue;
+			}
+
+			// Purchased tracks are copies that can go
+			for (vector<unsigned int>::const_iterator indexIter = playlistIter->second.m_trackIndices.begin();
+				indexIter != playlistIter->second.m_trackIndices.end(); ++indexIter)
+			{
+				release_track(*indexIter);
+			}
+			m_purchasedTracks.erase(playlistIter);
+		}
+
+		if (purchaseYears.empty() == false)
+		{
+			match_purchases(&purchaseYears);
+
+			dump_playlists(m_purchasedTracks, "Bandcamp ", &purchaseYears);
+			remove_playlists(m_purchasedTracks, "Bandcamp ", purchaseYears);
+		}
+	}
+
+	MusicFolderCrawler::write_playlists(pChanges);
+}
+
+void BandcampMusicCrawler::clear_playlists(void)
+{
+	m_purchasedTracks.clear();
+
+	MusicFolderCrawler::clear_playlists();
+}
+
+void BandcampMusicCrawler::remove_track(const string &entryName)
+{
+	PathTracks::const_iterator pathIter = m_pathTracks.find(entryName);
+
+	if (pathIter != m_pathTracks.end())
+	{
+		unsigned int trackIndex = pathIter->second;
+		const Track &oldTrack = m_tracks[trackIndex];
+		string artist(fold_case(oldTrack.get_artist()));
+		ArtistAlbums::iterator albumsIter = m_artistAlbums.find(artist);
+
+		// Forget about this track's album
+		if (albumsIter != m_artistAlbums.end())
+		{
+			AlbumTracks::iterator albumIter = albumsIter->second.find(fold_case(oldTrack.get_album()));
+
+			if (albumIter != albumsIter->second.end())
+			{
+				vector<unsigned int>::iterator indexIter = find(albumIter->second.begin(),
+					albumIter->second.end(), trackIndex);
+
+				if (indexIter != albumIter->second.end())
+				{
+					albumIter->second.erase(indexIter);
+				}
+				if (albumIter->second.empty() == true)
+				{
+					albumsIter->second.erase(albumIter);
+				}
+			}
+			if (albumsIter->second.empty() == true)
+			{
+				m_artistAlbums.erase(albumsIter);
+			}
+		}
+
+		m_pathAlbums.erase(entryName);
+	}
+
+	MusicFolderCrawler::remove_track(entryName);
 }
 
-unsigned int BandcampMusicCrawler::find_album_tracks(const vector<Track> *pTracks,
-	const BandcampAlbum &thisAlbum, const string &albumArtUrl,
-	unsigned int year, char *timeStr, size_t strSize)
+unsigned int BandcampMusicCrawler::find_album_tracks(const BandcampAlbum &thisAlbum,
+	const string &albumArtUrl, unsigned int year,
+	char *timeStr, size_t strSize)
 {
 	unsigned int albumTrackCount = 0;
+	ArtistAlbums::const_iterator artistIter = m_artistAlbums.find(thisAlbum.m_artist);
 
-	if ((pTracks == NULL) ||
-		(pTracks->empty() == true))
+	if (artistIter == m_artistAlbums.end())
 	{
 		return albumTrackCount;
 	}
 
-	for (vector<Track>::const_iterator trackIter = pTracks->begin();
-		trackIter != pTracks->end(); ++trackIter)
+	AlbumTracks::const_iterator albumIter = artistIter->second.find(thisAlbum.m_album);
+
+	if (albumIter == artistIter->second.end())
 	{
-		Track newTrack(*trackIter);
+		return albumTrackCount;
+	}
 
-		// Is this the same album?
-		if (thisAlbum.m_album != to_lower_case(newTrack.get_album()))
+	// Only look at this album's tracks
+	for (vector<unsigned int>::const_iterator indexIter = albumIter->second.begin();
+		indexIter != albumIter->second.end(); ++indexIter)
+	{
+		if (*indexIter >= m_tracks.size())
 		{
 			continue;
 		}
 
+		// Purchased tracks differ by their album art and mtime, they get their own entries in the store
+		Track newTrack(m_tracks[*indexIter]);
+
 		// Record the album art
 		newTrack.set_album_art(albumArtUrl);
 
@@ -287,23 +455,16 @@ unsigned int BandcampMusicCrawler::find_album_tracks(const vector<Track> *pTrack
 		{
 			newTrack.set_mtime((time_t)atoi(timeStr));
 		}
-		newTrack.set_sort(TRACK_SORT_MTIME);
 
-		map<int, vector<Track>*>::iterator yearIter = m_purchasedTracks.find(year);
+		YearPlaylists::iterator yearIter = m_purchasedTracks.find(year);
 
 		if (yearIter == m_purchasedTracks.end())
 		{
-			vector<Track> *pYearTracks = new vector<Track>();
+			LogMessage(LOG_LEVEL_DEBUG) << "Bandcamp playlist " << year;
 
-			clog << "Bandcamp playlist " << year << endl;
-
-			pYearTracks->push_back(newTrack);
-			m_purchasedTracks.insert(pair<int, vector<Track>*>(year, pYearTracks));
-		}
-		else if (yearIter->second != NULL)
-		{
-			yearIter->second->push_back(newTrack);
+			yearIter = m_purchasedTracks.insert(pair<int, Playlist>(year, Playlist(TRACK_SORT_MTIME))).first;
 		}
+		yearIter->second.m_trackIndices.push_back(add_track(newTrack));
 
 		++albumTrackCount;
 	}
@@ -316,7 +477,7 @@ void BandcampMusicCrawler::load_lookup_file(void)
 	if ((m_lookupObject.isObject() == false) ||
 		(m_lookupObject.empty() == true))
 	{
-		clog << "No lookup object" << endl;
+		LogMessage(LOG_LEVEL_INFO) << "No lookup object";
 		return;
 	}
 
@@ -340,12 +501,12 @@ void BandcampMusicCrawler::load_lookup_file(void)
 		}
 
 		Json::Value resolvedAlbumObject(*albumIter);
-		string albumName(albumValue.asString());
+		string albumName(fold_case(albumValue.asString()));
 
 		if (resolvedAlbumObject.isObject() == true)
 		{
-			string albumValue(to_lower_case(resolvedAlbumObject["album"].asString()));
-			string artistValue(to_lower_case(resolvedAlbumObject["artist"].asString()));
+			string albumValue(fold_case(resolvedAlbumObject["album"].asString()));
+			string artistValue(fold_case(resolvedAlbumObject["artist"].asString()));
 			string pathValue(resolvedAlbumObject["path"].asString());
 
 			// Album and artist names are provided
@@ -359,7 +520,7 @@ void BandcampMusicCrawler::load_lookup_file(void)
 			// ...or the path to the folder is specified
 			else if (pathValue.empty() == false)
 			{
-				map<string, BandcampAlbum>::const_iterator pathIter = m_pathAlbums.find(pathValue);
+				PathAlbums::const_iterator pathIter = m_pathAlbums.find(pathValue);
 
 				if (pathIter == m_pathAlbums.end())
 				{
@@ -376,7 +537,7 @@ void BandcampMusicCrawler::load_lookup_file(void)
 		}
 	}
 
-	clog << "Lookup file has " << m_resolvedAlbums.size() << "/" << m_lookupObject.size() << " albums" << endl;
+	LogMessage(LOG_LEVEL_INFO) << "Lookup file has " << m_resolvedAlbums.size() << "/" << m_lookupObject.size() << " albums";
 }
 
 bool BandcampMusicCrawler::resolve_missing_album(BandcampAlbum &album)
@@ -385,7 +546,11 @@ bool BandcampMusicCrawler::resolve_missing_album(BandcampAlbum &album)
 
 	if (albumIter == m_resolvedAlbums.end())
 	{
-		m_missingAlbums.push_back(album);
+		// Purchases may be matched again when watching, only record each album once
+		if (find(m_missingAlbums.begin(), m_missingAlbums.end(), album) == m_missingAlbums.end())
+		{
+			m_missingAlbums.push_back(album);
+		}
 
 		return false;
 	}
@@ -394,14 +559,14 @@ bool BandcampMusicCrawler::resolve_missing_album(BandcampAlbum &album)
 
 	if (resolvedAlbum.m_artist.empty() == false)
 	{
-		clog << "Resolved artist " << album.m_artist << " to " << resolvedAlbum.m_artist << endl;
+		LogMessage(LOG_LEVEL_DEBUG) << "Resolved artist " << album.m_artist << " to " << resolvedAlbum.m_artist;
 
 		album.m_artist = resolvedAlbum.m_artist;
 	}
 
 	if (resolvedAlbum.m_album.empty() == false)
 	{
-		clog << "Resolved album " << album.m_album << " to " << resolvedAlbum.m_album << endl;
+		LogMessage(LOG_LEVEL_DEBUG) << "Resolved album " << album.m_album << " to " << resolvedAlbum.m_album;
 
 		album.m_album = resolvedAlbum.m_album;
 	}
@@ -443,7 +608,7 @@ void BandcampMusicCrawler::write_lookup_file(void)
 
 	albums += "}";
 
-	clog << "Recorded " << m_missingAlbums.size() << " unknown albums to the lookup file" << endl;
+	LogMessage(LOG_LEVEL_INFO) << "Recorded " << m_missingAlbums.size() << " unknown albums to the lookup file";
 
 	Json::Reader reader;
 	Json::Value lookupObject;
@@ -452,7 +617,7 @@ void BandcampMusicCrawler::write_lookup_file(void)
 	{
 		ofstream outputFile;
 
-		clog << "Writing " << m_lookupFileName << endl;
+		LogMessage(LOG_LEVEL_DEBUG) << "Writing " << m_lookupFileName;
 
 		outputFile.open(m_lookupFileName.c_str());
 
@@ -467,12 +632,12 @@ void BandcampMusicCrawler::write_lookup_file(void)
 		}
 		else
 		{
-			clog << "Failed to write to " << m_lookupFileName << endl;
+			LogMessage(LOG_LEVEL_ERROR) << "Failed to write to " << m_lookupFileName;
 		}
 	}
 	else
 	{
-		clog << "Failed to write to " << m_lookupFileName << endl;
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write to " << m_lookupFileName;
 	}
 }
 
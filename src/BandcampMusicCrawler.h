@@ -21,9 +21,11 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 #include <json/json.h>
 
+#include "BandcampCollection.h"
 #include "MusicCrawler.h"
 #include "Track.h"
 
@@ -39,6 +41,8 @@ class BandcampAlbum
 
 		bool operator<(const BandcampAlbum &other) const;
 
+		bool operator==(const BandcampAlbum &other) const;
+
 		std::string to_key(void) const;
 
 		std::string m_artist;
@@ -46,14 +50,22 @@ class BandcampAlbum
 
 };
 
+// Maps that grow with each track are allocated from the crawler's arena, unless watching
+typedef std::map<std::string, BandcampAlbum, std::less<std::string>,
+	ArenaAllocator<std::pair<const std::string, BandcampAlbum> > > PathAlbums;
+typedef std::map<std::string, std::vector<unsigned int>, std::less<std::string>,
+	ArenaAllocator<std::pair<const std::string, std::vector<unsigned int> > > > AlbumTracks;
+typedef std::map<std::string, AlbumTracks, std::less<std::string>,
+	ArenaAllocator<std::pair<const std::string, AlbumTracks> > > ArtistAlbums;
+
 class BandcampMusicCrawler : public MusicFolderCrawler
 {
 	public:
 		BandcampMusicCrawler(const std::string &topLevelDirName,
-			const char *pCollection);
+			const BandcampCollection &collection);
 		BandcampMusicCrawler(const std::string &topLevelDirName,
-			const char *pCollection,
-			const char *pLookup);
+			const BandcampCollection &collection,
+			const char *pLookup, off_t lookupLength);
 		virtual ~BandcampMusicCrawler();
 
 		virtual void crawl(void);
@@ -61,19 +73,27 @@ class BandcampMusicCrawler : public MusicFolderCrawler
 		static std::string m_lookupFileName;
 
 	protected:
-		Json::Value m_bandcampObject;
+		const BandcampCollection &m_collection;
 		Json::Value m_lookupObject;
 		std::map<std::string, BandcampAlbum> m_resolvedAlbums;
-		std::map<std::string, BandcampAlbum> m_pathAlbums;
+		PathAlbums m_pathAlbums;
 		std::vector<BandcampAlbum> m_missingAlbums;
-		std::map<int, std::vector<Track>*> m_purchasedTracks;
+		YearPlaylists m_purchasedTracks;
+		ArtistAlbums m_artistAlbums;
 		bool m_parseError;
 
 		virtual void record_album_artist(const std::string &entryName,
 			const std::string &artist, const std::string &album);
 
-		unsigned int find_album_tracks(const std::vector<Track> *pTracks,
-			const BandcampAlbum &thisAlbum,
+		virtual void write_playlists(const PlaylistChanges *pChanges);
+
+		virtual void clear_playlists(void);
+
+		virtual void remove_track(const std::string &entryName);
+
+		unsigned int match_purchases(const std::set<int> *pYears);
+
+		unsigned int find_album_tracks(const BandcampAlbum &thisAlbum,
 			const std::string &albumArtUrl,
 			unsigned int year, char *timeStr, size_t strSize);
 
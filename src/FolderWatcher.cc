@@ -0,0 +1,301 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/types.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "FolderWatcher.h"
+#include "Logger.h"
+
+using std::map;
+using std::set;
+using std::string;
+
+// Files that were written to, moved around or deleted, and folders that appeared
+#define WATCHED_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+static time_t get_monotonic_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec;
+}
+
+FolderWatcher::FolderWatcher(const string &topLevelDirName) :
+	m_topLevelDirName(topLevelDirName),
+	m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+	// Paths are reported without a trailing slash
+	while ((m_topLevelDirName.length() > 1) &&
+		(m_topLevelDirName[m_topLevelDirName.length() - 1] == '/'))
+	{
+		m_topLevelDirName.resize(m_topLevelDirName.length() - 1);
+	}
+
+	if (m_fd < 0)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to initialize inotify";
+		return;
+	}
+
+	set<int> watchedFolders;
+
+	add_folder(m_topLevelDirName, watchedFolders);
+}
+
+FolderWatcher::~FolderWatcher()
+{
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+}
+
+bool FolderWatcher::is_ready(void) const
+{
+	return ((m_fd >= 0) && (m_folders.empty() == false));
+}
+
+unsigned int FolderWatcher::get_folders_count(void) const
+{
+	return (unsigned int)m_folders.size();
+}
+
+bool FolderWatcher::wait_for_changes(unsigned int delay,
+	set<string> &changedPaths)
+{
+	time_t lastChangeTime = 0;
+
+	changedPaths.clear();
+
+	if (m_fd < 0)
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		int timeout = -1;
+
+		// Wait for changes to settle down, bulk copies trigger lots of events
+		if (changedPaths.empty() == false)
+		{
+			time_t elapsedTime = get_monotonic_time() - lastChangeTime;
+
+			if (elapsedTime >= (time_t)delay)
+			{
+				return true;
+			}
+			timeout = (int)(((time_t)delay - elapsedTime) * 1000);
+		}
+
+		struct pollfd pollFd;
+
+		pollFd.fd = m_fd;
+		pollFd.events = POLLIN;
+		pollFd.revents = 0;
+
+		int pollStatus = poll(&pollFd, 1, timeout);
+		if (pollStatus < 0)
+		{
+			// Interrupted by a signal, time to stop
+			if (errno != EINTR)
+			{
+				LogMessage(LOG_LEVEL_ERROR) << "Failed to wait for changes";
+			}
+			return false;
+		}
+		else if (pollStatus > 0)
+		{
+			size_t changesCount = changedPaths.size();
+
+			if (read_events(changedPaths) == false)
+			{
+				return false;
+			}
+
+			if (changedPaths.size() != changesCount)
+			{
+				lastChangeTime = get_monotonic_time();
+			}
+		}
+	}
+
+	return false;
+}
+
+void FolderWatcher::add_folder(const string &dirName,
+	set<int> &watchedFolders)
+{
+	// Folders that are watched already get the same descriptor
+	int wd = inotify_add_watch(m_fd, dirName.c_str(), WATCHED_EVENTS);
+	if (wd < 0)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to watch " << dirName;
+		return;
+	}
+
+	// Don't loop through links to folders that were walked already
+	if (watchedFolders.insert(wd).second == false)
+	{
+		return;
+	}
+	// Walking again, the folder may have been moved since
+	m_folders[wd] = dirName;
+
+	DIR *pDir = opendir(dirName.c_str());
+	if (pDir == NULL)
+	{
+		return;
+	}
+
+	// Watch sub-folders too, dotfiles are skipped like the crawler does
+	struct dirent *pDirEntry = readdir(pDir);
+	while (pDirEntry != NULL)
+	{
+		if (pDirEntry->d_name[0] != '.')
+		{
+			string entryName(dirName + "/" + pDirEntry->d_name);
+			bool isDir = (pDirEntry->d_type == DT_DIR);
+
+			if ((pDirEntry->d_type == DT_LNK) ||
+				(pDirEntry->d_type == DT_UNKNOWN))
+			{
+				struct stat fileStat;
+
+				isDir = ((stat(entryName.c_str(), &fileStat) == 0) &&
+					(S_ISDIR(fileStat.st_mode)));
+			}
+
+			if (isDir == true)
+			{
+				add_folder(entryName, watchedFolders);
+			}
+		}
+
+		// Next entry
+		pDirEntry = readdir(pDir);
+	}
+
+	closedir(pDir);
+}
+
+void FolderWatcher::remove_folder(const string &dirName)
+{
+	map<int, string>::iterator folderIter = m_folders.begin();
+
+	while (folderIter != m_folders.end())
+	{
+		const string &folderName = folderIter->second;
+
+		if ((folderName.compare(0, dirName.length(), dirName) == 0) &&
+			((folderName.length() == dirName.length()) ||
+			(folderName[dirName.length()] == '/')))
+		{
+			inotify_rm_watch(m_fd, folderIter->first);
+			m_folders.erase(folderIter++);
+		}
+		else
+		{
+			++folderIter;
+		}
+	}
+}
+
+bool FolderWatcher::read_events(set<string> &changedPaths)
+{
+	char eventsBuffer[65536] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t bytesCount = read(m_fd, eventsBuffer, sizeof(eventsBuffer));
+
+	while (bytesCount > 0)
+	{
+		for (ssize_t eventPos = 0; eventPos < bytesCount; )
+		{
+			const struct inotify_event *pEvent = (const struct inotify_event *)&eventsBuffer[eventPos];
+
+			eventPos += sizeof(struct inotify_event) + pEvent->len;
+
+			if (pEvent->mask & IN_Q_OVERFLOW)
+			{
+				set<int> watchedFolders;
+
+				// Events were lost, everything has to be looked at again.
+				// Folders may have been created or moved meanwhile, walk them all again
+				LogMessage(LOG_LEVEL_WARNING) << "Too many changes, watching from the top";
+				add_folder(m_topLevelDirName, watchedFolders);
+				changedPaths.insert(m_topLevelDirName);
+				continue;
+			}
+			if (pEvent->mask & IN_IGNORED)
+			{
+				// The folder was deleted or isn't watched any more
+				m_folders.erase(pEvent->wd);
+				continue;
+			}
+
+			map<int, string>::const_iterator folderIter = m_folders.find(pEvent->wd);
+			if ((folderIter == m_folders.end()) ||
+				(pEvent->len == 0) ||
+				(pEvent->name[0] == '.'))
+			{
+				continue;
+			}
+
+			string entryName(folderIter->second + "/" + pEvent->name);
+
+			if (pEvent->mask & IN_ISDIR)
+			{
+				if (pEvent->mask & (IN_CREATE | IN_MOVED_TO))
+				{
+					set<int> watchedFolders;
+
+					add_folder(entryName, watchedFolders);
+				}
+				else if (pEvent->mask & (IN_DELETE | IN_MOVED_FROM))
+				{
+					remove_folder(entryName);
+				}
+			}
+
+			changedPaths.insert(entryName);
+		}
+
+		bytesCount = read(m_fd, eventsBuffer, sizeof(eventsBuffer));
+	}
+
+	if ((bytesCount < 0) &&
+		(errno != EAGAIN) &&
+		(errno != EINTR))
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to read changes";
+		return false;
+	}
+
+	return true;
+}
+#endif
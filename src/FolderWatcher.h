@@ -0,0 +1,60 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _FOLDER_WATCHER_H
+#define _FOLDER_WATCHER_H
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <map>
+#include <set>
+#include <string>
+
+// Watches a directory tree with inotify, and reports which paths changed once changes settle down
+class FolderWatcher
+{
+	public:
+		FolderWatcher(const std::string &topLevelDirName);
+		virtual ~FolderWatcher();
+
+		bool is_ready(void) const;
+
+		unsigned int get_folders_count(void) const;
+
+		bool wait_for_changes(unsigned int delay,
+			std::set<std::string> &changedPaths);
+
+	protected:
+		std::string m_topLevelDirName;
+		int m_fd;
+		std::map<int, std::string> m_folders;
+
+		void add_folder(const std::string &dirName,
+			std::set<int> &watchedFolders);
+
+		void remove_folder(const std::string &dirName);
+
+		bool read_events(std::set<std::string> &changedPaths);
+
+	private:
+		FolderWatcher(const FolderWatcher &other);
+		FolderWatcher &operator=(const FolderWatcher &other);
+
+};
+#endif
+
+#endif // _FOLDER_WATCHER_H
@@ -0,0 +1,162 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_LIBURING
+#include <unistd.h>
+#include <vector>
+
+#include "HeaderStream.h"
+
+using std::string;
+using std::vector;
+
+HeaderStream::HeaderStream(const string &fileName,
+	int fd, char *pHeader, size_t headerLength,
+	off_t fileLength) :
+	TagLib::IOStream(),
+	m_fileName(fileName),
+	m_fd(fd),
+	m_pHeader(pHeader),
+	m_headerLength(headerLength),
+	m_fileLength(fileLength),
+	m_position(0)
+{
+}
+
+HeaderStream::~HeaderStream()
+{
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+	if (m_pHeader != NULL)
+	{
+		delete[] m_pHeader;
+	}
+}
+
+TagLib::FileName HeaderStream::name() const
+{
+	return m_fileName.c_str();
+}
+
+TagLib::ByteVector HeaderStream::readBlock(stream_size_t length)
+{
+	TagLib::ByteVector data;
+
+	if ((m_position < 0) ||
+		(m_position >= m_fileLength))
+	{
+		return data;
+	}
+	if ((off_t)length > m_fileLength - m_position)
+	{
+		length = (stream_size_t)(m_fileLength - m_position);
+	}
+
+	// Serve what we can from the header
+	if (m_position < (off_t)m_headerLength)
+	{
+		size_t headerBytes = m_headerLength - (size_t)m_position;
+
+		if (headerBytes > length)
+		{
+			headerBytes = length;
+		}
+
+		data = TagLib::ByteVector(m_pHeader + m_position, (unsigned int)headerBytes);
+		m_position += headerBytes;
+		length -= headerBytes;
+	}
+
+	// ...and read the rest from the file
+	if ((length > 0) &&
+		(m_fd >= 0))
+	{
+		vector<char> buffer(length);
+		ssize_t bytesRead = pread(m_fd, &buffer[0], length, m_position);
+
+		if (bytesRead > 0)
+		{
+			data.append(TagLib::ByteVector(&buffer[0], (unsigned int)bytesRead));
+			m_position += bytesRead;
+		}
+	}
+
+	return data;
+}
+
+void HeaderStream::writeBlock(const TagLib::ByteVector &)
+{
+	// Read-only
+}
+
+void HeaderStream::insert(const TagLib::ByteVector &,
+	stream_start_t, stream_size_t)
+{
+	// Read-only
+}
+
+void HeaderStream::removeBlock(stream_start_t,
+	stream_size_t)
+{
+	// Read-only
+}
+
+bool HeaderStream::readOnly() const
+{
+	return true;
+}
+
+bool HeaderStream::isOpen() const
+{
+	return ((m_fd >= 0) || (m_pHeader != NULL));
+}
+
+void HeaderStream::seek(stream_offset_t offset,
+	TagLib::IOStream::Position p)
+{
+	if (p == TagLib::IOStream::Current)
+	{
+		m_position += offset;
+	}
+	else if (p == TagLib::IOStream::End)
+	{
+		m_position = m_fileLength + offset;
+	}
+	else
+	{
+		m_position = offset;
+	}
+}
+
+stream_offset_t HeaderStream::tell() const
+{
+	return (stream_offset_t)m_position;
+}
+
+stream_offset_t HeaderStream::length()
+{
+	return (stream_offset_t)m_fileLength;
+}
+
+void HeaderStream::truncate(stream_offset_t)
+{
+	// Read-only
+}
+#endif
@@ -0,0 +1,87 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _HEADER_STREAM_H
+#define _HEADER_STREAM_H
+
+#ifdef HAVE_LIBURING
+#include <sys/types.h>
+#include <string>
+#include <taglib.h>
+#include <tiostream.h>
+
+#if TAGLIB_MAJOR_VERSION >= 2
+typedef TagLib::offset_t stream_offset_t;
+typedef TagLib::offset_t stream_start_t;
+typedef size_t stream_size_t;
+#else
+typedef long stream_offset_t;
+typedef unsigned long stream_start_t;
+typedef unsigned long stream_size_t;
+#endif
+
+// A read-only stream over an open file whose first bytes were already read
+class HeaderStream : public TagLib::IOStream
+{
+	public:
+		HeaderStream(const std::string &fileName,
+			int fd, char *pHeader, size_t headerLength,
+			off_t fileLength);
+		virtual ~HeaderStream();
+
+		virtual TagLib::FileName name() const;
+
+		virtual TagLib::ByteVector readBlock(stream_size_t length);
+
+		virtual void writeBlock(const TagLib::ByteVector &data);
+
+		virtual void insert(const TagLib::ByteVector &data,
+			stream_start_t start = 0, stream_size_t replace = 0);
+
+		virtual void removeBlock(stream_start_t start = 0,
+			stream_size_t length = 0);
+
+		virtual bool readOnly() const;
+
+		virtual bool isOpen() const;
+
+		virtual void seek(stream_offset_t offset,
+			TagLib::IOStream::Position p = TagLib::IOStream::Beginning);
+
+		virtual stream_offset_t tell() const;
+
+		virtual stream_offset_t length();
+
+		virtual void truncate(stream_offset_t length);
+
+	protected:
+		std::string m_fileName;
+		int m_fd;
+		char *m_pHeader;
+		size_t m_headerLength;
+		off_t m_fileLength;
+		off_t m_position;
+
+	private:
+		HeaderStream(const HeaderStream &other);
+		HeaderStream &operator=(const HeaderStream &other);
+
+};
+#endif
+
+#endif // _HEADER_STREAM_H
@@ -0,0 +1,566 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "LibraryGenerator.h"
+#include "Utilities.h"
+
+using std::clog;
+using std::endl;
+using std::ios;
+using std::ofstream;
+using std::string;
+
+static const char *g_monthNames[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+static const char *g_extensions[] = { ".mp3", ".flac", ".ogg", ".m4a" };
+
+static void append_be16(unsigned int value, string &data)
+{
+	data += (char)((value >> 8) & 0xFF);
+	data += (char)(value & 0xFF);
+}
+
+static void append_be32(unsigned int value, string &data)
+{
+	data += (char)((value >> 24) & 0xFF);
+	data += (char)((value >> 16) & 0xFF);
+	data += (char)((value >> 8) & 0xFF);
+	data += (char)(value & 0xFF);
+}
+
+static void append_le32(unsigned int value, string &data)
+{
+	data += (char)(value & 0xFF);
+	data += (char)((value >> 8) & 0xFF);
+	data += (char)((value >> 16) & 0xFF);
+	data += (char)((value >> 24) & 0xFF);
+}
+
+static string number_to_string(unsigned int number)
+{
+	char numberStr[16];
+
+	snprintf(numberStr, sizeof(numberStr), "%u", number);
+
+	return numberStr;
+}
+
+static void append_id3v2_frame(const char *pFrameId, const string &value,
+	string &data)
+{
+	// ID3v2.3, ISO-8859-1 text
+	data.append(pFrameId, 4);
+	append_be32((unsigned int)value.length() + 1, data);
+	append_be16(0, data);
+	data += '\0';
+	data += value;
+}
+
+static string get_xiph_comment(const string &title,
+	const string &artist, const string &album,
+	unsigned int number, unsigned int year)
+{
+	const string vendor("mplibgen");
+	string fields[5] = { "TITLE=" + title, "ARTIST=" + artist, "ALBUM=" + album,
+		"TRACKNUMBER=" + number_to_string(number), "DATE=" + number_to_string(year) };
+	string comment;
+
+	append_le32((unsigned int)vendor.length(), comment);
+	comment += vendor;
+	append_le32(5, comment);
+	for (unsigned int fieldNum = 0; fieldNum < 5; ++fieldNum)
+	{
+		append_le32((unsigned int)fields[fieldNum].length(), comment);
+		comment += fields[fieldNum];
+	}
+
+	return comment;
+}
+
+static unsigned int ogg_crc(const string &page)
+{
+	unsigned int crc = 0;
+
+	// Polynomial 0x04C11DB7, not reflected
+	for (string::size_type pos = 0; pos < page.length(); ++pos)
+	{
+		crc ^= (unsigned int)(unsigned char)page[pos] << 24;
+		for (unsigned int bitNum = 0; bitNum < 8; ++bitNum)
+		{
+			crc = ((crc & 0x80000000) != 0 ? (crc << 1) ^ 0x04C11DB7 : crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+static void append_ogg_page(unsigned char headerType, unsigned int sequenceNum,
+	const string *pPackets, unsigned int packetsCount,
+	string &data)
+{
+	string page("OggS");
+	string segmentTable, pageData;
+
+	page += '\0';
+	page += (char)headerType;
+	// Granule position
+	append_le32(0, page);
+	append_le32(0, page);
+	// Serial number
+	append_le32(0x6D70706C, page);
+	append_le32(sequenceNum, page);
+	// Checksum, filled in below
+	append_le32(0, page);
+
+	for (unsigned int packetNum = 0; packetNum < packetsCount; ++packetNum)
+	{
+		string::size_type length = pPackets[packetNum].length();
+
+		// Lacing values, a packet ends with a segment shorter than 255
+		while (length >= 255)
+		{
+			segmentTable += (char)255;
+			length -= 255;
+		}
+		segmentTable += (char)length;
+		pageData += pPackets[packetNum];
+	}
+	page += (char)segmentTable.length();
+	page += segmentTable;
+	page += pageData;
+
+	unsigned int crc = ogg_crc(page);
+
+	page[22] = (char)(crc & 0xFF);
+	page[23] = (char)((crc >> 8) & 0xFF);
+	page[24] = (char)((crc >> 16) & 0xFF);
+	page[25] = (char)((crc >> 24) & 0xFF);
+
+	data += page;
+}
+
+static string get_mp4_atom(const char *pName, const string &content)
+{
+	string atom;
+
+	append_be32(8 + (unsigned int)content.length(), atom);
+	atom.append(pName, 4);
+	atom += content;
+
+	return atom;
+}
+
+static string get_mp4_text_item(const char *pName, const string &value)
+{
+	string data;
+
+	// UTF-8, default locale
+	append_be32(1, data);
+	append_be32(0, data);
+	data += value;
+
+	return get_mp4_atom(pName, get_mp4_atom("data", data));
+}
+
+LibraryGenerator::LibraryGenerator(const string &topLevelDirName,
+	unsigned int artistsCount, unsigned int albumsCount,
+	unsigned int tracksCount) :
+	m_artistsCount(artistsCount),
+	m_albumsCount(albumsCount),
+	m_tracksCount(tracksCount),
+	m_topLevelDirName(topLevelDirName)
+{
+	if ((m_topLevelDirName.empty() == false) &&
+		(m_topLevelDirName[m_topLevelDirName.length() - 1] != '/'))
+	{
+		m_topLevelDirName += "/";
+	}
+}
+
+LibraryGenerator::~LibraryGenerator()
+{
+}
+
+bool LibraryGenerator::generate(void)
+{
+	if ((mkdir(m_topLevelDirName.c_str(), 0755) != 0) &&
+		(errno != EEXIST))
+	{
+		clog << "Couldn't create " << m_topLevelDirName << endl;
+		return false;
+	}
+
+	for (unsigned int artistNum = 0; artistNum < m_artistsCount; ++artistNum)
+	{
+		string artistDirName(m_topLevelDirName + get_artist(artistNum));
+
+		if ((mkdir(artistDirName.c_str(), 0755) != 0) &&
+			(errno != EEXIST))
+		{
+			clog << "Couldn't create " << artistDirName << endl;
+			return false;
+		}
+
+		for (unsigned int albumNum = 0; albumNum < m_albumsCount; ++albumNum)
+		{
+			string albumDirName(artistDirName + "/" + get_album(artistNum, albumNum));
+
+			if ((mkdir(albumDirName.c_str(), 0755) != 0) &&
+				(errno != EEXIST))
+			{
+				clog << "Couldn't create " << albumDirName << endl;
+				return false;
+			}
+
+			for (unsigned int trackNum = 0; trackNum < m_tracksCount; ++trackNum)
+			{
+				if (write_track(artistNum, albumNum, trackNum) == false)
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	if ((write_collection() == false) ||
+		(write_playlist() == false))
+	{
+		return false;
+	}
+
+	clog << "Generated " << m_artistsCount * m_albumsCount * m_tracksCount << " track(s) in " << m_topLevelDirName << endl;
+
+	return true;
+}
+
+string LibraryGenerator::get_track_path(unsigned int artistNum,
+	unsigned int albumNum, unsigned int trackNum) const
+{
+	char trackStr[16];
+
+	// Albums are of a single format, formats take turns
+	snprintf(trackStr, sizeof(trackStr), "%02u", trackNum + 1);
+
+	return m_topLevelDirName + get_artist(artistNum) + "/" + get_album(artistNum, albumNum) + "/"
+		+ trackStr + " " + get_title(artistNum, albumNum, trackNum)
+		+ g_extensions[(artistNum * m_albumsCount + albumNum) % 4];
+}
+
+unsigned int LibraryGenerator::get_year(unsigned int artistNum,
+	unsigned int albumNum) const
+{
+	return 1960 + (artistNum * 7 + albumNum * 3) % 60;
+}
+
+string LibraryGenerator::get_collection_file_name(void) const
+{
+	return m_topLevelDirName + "collection_items.json";
+}
+
+string LibraryGenerator::get_playlist_file_name(void) const
+{
+	return m_topLevelDirName + "Library.m3u8";
+}
+
+string LibraryGenerator::get_artist(unsigned int artistNum) const
+{
+	char artistStr[32];
+
+	snprintf(artistStr, sizeof(artistStr), "Artist %05u", artistNum);
+
+	return artistStr;
+}
+
+string LibraryGenerator::get_album(unsigned int artistNum,
+	unsigned int albumNum) const
+{
+	char albumStr[32];
+
+	snprintf(albumStr, sizeof(albumStr), "Album %05u-%02u", artistNum, albumNum);
+
+	return albumStr;
+}
+
+string LibraryGenerator::get_title(unsigned int artistNum,
+	unsigned int albumNum, unsigned int trackNum) const
+{
+	char titleStr[32];
+
+	snprintf(titleStr, sizeof(titleStr), "Song %u", (artistNum + albumNum * 31 + trackNum * 17) % 1000);
+
+	return titleStr;
+}
+
+bool LibraryGenerator::write_track(unsigned int artistNum,
+	unsigned int albumNum, unsigned int trackNum)
+{
+	string trackPath(get_track_path(artistNum, albumNum, trackNum));
+	string title(get_title(artistNum, albumNum, trackNum));
+	string artist(get_artist(artistNum));
+	string album(get_album(artistNum, albumNum));
+	unsigned int year = get_year(artistNum, albumNum);
+	string content;
+
+	switch ((artistNum * m_albumsCount + albumNum) % 4)
+	{
+		case 0:
+			content = get_mp3(title, artist, album, trackNum + 1, year);
+			break;
+		case 1:
+			content = get_flac(title, artist, album, trackNum + 1, year);
+			break;
+		case 2:
+			content = get_ogg(title, artist, album, trackNum + 1, year);
+			break;
+		default:
+			content = get_m4a(title, artist, album, trackNum + 1, year);
+			break;
+	}
+
+	ofstream trackFile(trackPath.c_str(), ios::out | ios::binary | ios::trunc);
+
+	trackFile.write(content.data(), content.length());
+	trackFile.close();
+	if (trackFile.fail() == true)
+	{
+		clog << "Couldn't write " << trackPath << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool LibraryGenerator::write_collection(void)
+{
+	string fileName(get_collection_file_name());
+	string content("{\"more_available\": false, \"items\": [");
+	char itemStr[128];
+	bool firstItem = true;
+
+	// Every other album was purchased on Bandcamp
+	for (unsigned int artistNum = 0; artistNum < m_artistsCount; ++artistNum)
+	{
+		for (unsigned int albumNum = 0; albumNum < m_albumsCount; albumNum += 2)
+		{
+			if (firstItem == false)
+			{
+				content += ", ";
+			}
+			firstItem = false;
+
+			content += "{\"band_name\": ";
+			append_json_string(get_artist(artistNum), content);
+			content += ", \"album_title\": ";
+			append_json_string(get_album(artistNum, albumNum), content);
+			snprintf(itemStr, sizeof(itemStr), ", \"purchased\": \"%02u %s %04u 10:00:00 GMT\", "
+				"\"item_art_url\": \"https://f4.bcbits.com/img/a%05u%02u_10.jpg\"}",
+				artistNum % 28 + 1, g_monthNames[albumNum % 12], 2010 + (artistNum + albumNum) % 15,
+				artistNum, albumNum);
+			content += itemStr;
+		}
+	}
+	content += "]}\n";
+
+	ofstream collectionFile(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+
+	collectionFile.write(content.data(), content.length());
+	collectionFile.close();
+	if (collectionFile.fail() == true)
+	{
+		clog << "Couldn't write " << fileName << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool LibraryGenerator::write_playlist(void)
+{
+	string fileName(get_playlist_file_name());
+	string content("#EXTM3U\r");
+
+	// Like iTunes exports, lines end with \r. The first track of every album is listed
+	for (unsigned int artistNum = 0; artistNum < m_artistsCount; ++artistNum)
+	{
+		for (unsigned int albumNum = 0; (albumNum < m_albumsCount) && (m_tracksCount > 0); ++albumNum)
+		{
+			content += "#EXTINF:180,";
+			content += get_artist(artistNum);
+			content += " - ";
+			content += get_title(artistNum, albumNum, 0);
+			content += "\r";
+			content += get_track_path(artistNum, albumNum, 0);
+			content += "\r";
+		}
+	}
+
+	ofstream playlistFile(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+
+	playlistFile.write(content.data(), content.length());
+	playlistFile.close();
+	if (playlistFile.fail() == true)
+	{
+		clog << "Couldn't write " << fileName << endl;
+		return false;
+	}
+
+	return true;
+}
+
+string LibraryGenerator::get_mp3(const string &title,
+	const string &artist, const string &album,
+	unsigned int number, unsigned int year)
+{
+	string frames, data("ID3\x03\x00\x00", 6);
+
+	append_id3v2_frame("TIT2", title, frames);
+	append_id3v2_frame("TPE1", artist, frames);
+	append_id3v2_frame("TALB", album, frames);
+	append_id3v2_frame("TRCK", number_to_string(number), frames);
+	append_id3v2_frame("TYER", number_to_string(year), frames);
+
+	unsigned int tagSize = (unsigned int)frames.length();
+
+	// Syncsafe
+	data += (char)((tagSize >> 21) & 0x7F);
+	data += (char)((tagSize >> 14) & 0x7F);
+	data += (char)((tagSize >> 7) & 0x7F);
+	data += (char)(tagSize & 0x7F);
+	data += frames;
+
+	// A few silent MPEG-1 Layer III frames, 128 kbps at 44.1 kHz, so that readers can sync
+	for (unsigned int frameNum = 0; frameNum < 4; ++frameNum)
+	{
+		data.append("\xFF\xFB\x90\x64", 4);
+		data.append(413, '\0');
+	}
+
+	return data;
+}
+
+string LibraryGenerator::get_flac(const string &title,
+	const string &artist, const string &album,
+	unsigned int number, unsigned int year)
+{
+	string data("fLaC");
+	string comment(get_xiph_comment(title, artist, album, number, year));
+
+	// STREAMINFO : 4096 samples blocks, 44.1 kHz, 2 channels, 16 bits, length unknown
+	append_be32(34, data);
+	append_be16(4096, data);
+	append_be16(4096, data);
+	data.append(6, '\0');
+	data.append("\x0A\xC4\x42\xF0", 4);
+	data.append(4, '\0');
+	data.append(16, '\0');
+
+	// VORBIS_COMMENT, the last block
+	append_be32(0x84000000 | (unsigned int)comment.length(), data);
+	data += comment;
+
+	return data;
+}
+
+string LibraryGenerator::get_ogg(const string &title,
+	const string &artist, const string &album,
+	unsigned int number, unsigned int year)
+{
+	string identification("\x01vorbis", 7);
+	string packets[2];
+	string data;
+
+	// Version 0, 2 channels at 44.1 kHz, 128 kbps nominal, block sizes 256 and 2048
+	append_le32(0, identification);
+	identification += '\x02';
+	append_le32(44100, identification);
+	append_le32(0, identification);
+	append_le32(128000, identification);
+	append_le32(0, identification);
+	identification += '\xB8';
+	identification += '\x01';
+	append_ogg_page(0x02, 0, &identification, 1, data);
+
+	packets[0] = "\x03vorbis";
+	packets[0] += get_xiph_comment(title, artist, album, number, year);
+	packets[0] += '\x01';
+	// A token setup header
+	packets[1] = "\x05vorbis";
+	packets[1] += '\0';
+	append_ogg_page(0x00, 1, packets, 2, data);
+
+	return data;
+}
+
+string LibraryGenerator::get_m4a(const string &title,
+	const string &artist, const string &album,
+	unsigned int number, unsigned int year)
+{
+	string ftyp("M4A ", 4), mvhd, hdlr, trkn, meta, items;
+
+	append_be32(0, ftyp);
+	ftyp.append("M4A mp42isom", 12);
+
+	// Version 0, 1000 units per second, no duration
+	mvhd.append(12, '\0');
+	append_be32(1000, mvhd);
+	append_be32(0, mvhd);
+	append_be32(0x00010000, mvhd);
+	append_be16(0x0100, mvhd);
+	mvhd.append(10, '\0');
+	// Identity matrix
+	append_be32(0x00010000, mvhd);
+	mvhd.append(12, '\0');
+	append_be32(0x00010000, mvhd);
+	mvhd.append(12, '\0');
+	append_be32(0x40000000, mvhd);
+	mvhd.append(24, '\0');
+	append_be32(2, mvhd);
+
+	hdlr.append(8, '\0');
+	hdlr += "mdirappl";
+	hdlr.append(9, '\0');
+
+	items += get_mp4_text_item("\xA9nam", title);
+	items += get_mp4_text_item("\xA9" "ART", artist);
+	items += get_mp4_text_item("\xA9" "alb", album);
+	// Track number out of an unknown total
+	append_be32(0, trkn);
+	append_be32(0, trkn);
+	append_be16(0, trkn);
+	append_be16(number, trkn);
+	append_be32(0, trkn);
+	items += get_mp4_atom("trkn", get_mp4_atom("data", trkn));
+	items += get_mp4_text_item("\xA9" "day", number_to_string(year));
+
+	// meta is a full atom
+	meta.append(4, '\0');
+	meta += get_mp4_atom("hdlr", hdlr);
+	meta += get_mp4_atom("ilst", items);
+
+	return get_mp4_atom("ftyp", ftyp) +
+		get_mp4_atom("moov", get_mp4_atom("mvhd", mvhd) +
+			get_mp4_atom("udta", get_mp4_atom("meta", meta)));
+}
@@ -0,0 +1,91 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _LIBRARY_GENERATOR_H
+#define _LIBRARY_GENERATOR_H
+
+#include <string>
+
+// Creates a synthetic music library of tiny tagged MP3, FLAC, Ogg Vorbis and M4A files
+// laid out as Artist/Album/Track, with a matching Bandcamp collection and M3U8 playlist.
+// The same parameters always produce the same library
+class LibraryGenerator
+{
+	public:
+		LibraryGenerator(const std::string &topLevelDirName,
+			unsigned int artistsCount, unsigned int albumsCount,
+			unsigned int tracksCount);
+		virtual ~LibraryGenerator();
+
+		bool generate(void);
+
+		std::string get_track_path(unsigned int artistNum,
+			unsigned int albumNum, unsigned int trackNum) const;
+
+		unsigned int get_year(unsigned int artistNum,
+			unsigned int albumNum) const;
+
+		std::string get_collection_file_name(void) const;
+
+		std::string get_playlist_file_name(void) const;
+
+		unsigned int m_artistsCount;
+		unsigned int m_albumsCount;
+		unsigned int m_tracksCount;
+
+	protected:
+		std::string m_topLevelDirName;
+
+		std::string get_artist(unsigned int artistNum) const;
+
+		std::string get_album(unsigned int artistNum,
+			unsigned int albumNum) const;
+
+		std::string get_title(unsigned int artistNum,
+			unsigned int albumNum, unsigned int trackNum) const;
+
+		bool write_track(unsigned int artistNum,
+			unsigned int albumNum, unsigned int trackNum);
+
+		bool write_collection(void);
+
+		bool write_playlist(void);
+
+		static std::string get_mp3(const std::string &title,
+			const std::string &artist, const std::string &album,
+			unsigned int number, unsigned int year);
+
+		static std::string get_flac(const std::string &title,
+			const std::string &artist, const std::string &album,
+			unsigned int number, unsigned int year);
+
+		static std::string get_ogg(const std::string &title,
+			const std::string &artist, const std::string &album,
+			unsigned int number, unsigned int year);
+
+		static std::string get_m4a(const std::string &title,
+			const std::string &artist, const std::string &album,
+			unsigned int number, unsigned int year);
+
+	private:
+		LibraryGenerator(const LibraryGenerator &other);
+		LibraryGenerator &operator=(const LibraryGenerator &other);
+
+};
+
+#endif // _LIBRARY_GENERATOR_H
@@ -0,0 +1,400 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <iostream>
+#include <sstream>
+
+#include "Logger.h"
+#include "Utilities.h"
+
+using std::clog;
+using std::endl;
+using std::ofstream;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+// What problems are called in the report, how they are logged and summarized, and what they are about
+static const struct
+{
+	const char *m_pName;
+	const char *m_pPrefix;
+	const char *m_pKind;
+	const char *m_pNoun;
+} g_problems[PROBLEM_COUNT] = {
+	{ "", "", "", "" },
+	{ "missing_artist", "Missing artist metadata on ", "Missing artist metadata", "file" },
+	{ "missing_title", "Missing title metadata on ", "Missing title metadata", "file" },
+	{ "missing_year", "Missing year metadata on ", "Missing year metadata", "file" },
+	{ "no_tags", "Failed to find tags in ", "Failed to find tags", "file" },
+	{ "load_failed", "Failed to load ", "Failed to load", "file" },
+	{ "open_failed", "Failed to open ", "Failed to open", "file" },
+	{ "not_audio", "Not an audio file ", "Not an audio file", "file" },
+	{ "unknown_type", "Unknown type for ", "Unknown type", "file" },
+	{ "unsupported_type", "Unsupported type for ", "Unsupported type", "file" },
+	{ "no_artist_tracks", "No tracks for artist ", "No tracks for artist", "album" },
+	{ "no_album_tracks", "No tracks for album ", "No tracks for album", "album" }
+};
+
+LogEntry::LogEntry(LogLevel level, const string &message,
+	LogProblem problem) :
+	m_level(level),
+	m_message(message),
+	m_problem(problem)
+{
+}
+
+LogEntry::LogEntry(const LogEntry &other) :
+	m_level(other.m_level),
+	m_message(other.m_message),
+	m_problem(other.m_problem)
+{
+}
+
+LogEntry::~LogEntry()
+{
+}
+
+LogEntry &LogEntry::operator=(const LogEntry &other)
+{
+	if (this != &other)
+	{
+		m_level = other.m_level;
+		m_message = other.m_message;
+		m_problem = other.m_problem;
+	}
+
+	return *this;
+}
+
+LogBuffer::LogBuffer(bool passThrough) :
+	m_passThrough(passThrough)
+{
+}
+
+LogBuffer::LogBuffer(const LogBuffer &other) :
+	m_entries(other.m_entries),
+	m_passThrough(other.m_passThrough)
+{
+}
+
+LogBuffer::~LogBuffer()
+{
+}
+
+LogBuffer &LogBuffer::operator=(const LogBuffer &other)
+{
+	if (this != &other)
+	{
+		m_entries = other.m_entries;
+		m_passThrough = other.m_passThrough;
+	}
+
+	return *this;
+}
+
+void LogBuffer::log(LogLevel level, const string &message)
+{
+	if (m_passThrough == true)
+	{
+		Logger::log(level, message);
+	}
+	else if (Logger::is_enabled(level) == true)
+	{
+		m_entries.push_back(LogEntry(level, message));
+	}
+}
+
+void LogBuffer::problem(LogProblem problem, const string &name)
+{
+	if (m_passThrough == true)
+	{
+		Logger::problem(problem, name);
+	}
+	else
+	{
+		m_entries.push_back(LogEntry(LOG_LEVEL_WARNING, name, problem));
+	}
+}
+
+void LogBuffer::append(const LogBuffer &other)
+{
+	if (m_passThrough == true)
+	{
+		Logger::flush(other);
+	}
+	else
+	{
+		m_entries.insert(m_entries.end(), other.m_entries.begin(), other.m_entries.end());
+	}
+}
+
+void LogBuffer::clear(void)
+{
+	m_entries.clear();
+}
+
+bool Logger::start(void)
+{
+	if (m_started == true)
+	{
+		return true;
+	}
+
+	if (m_problemsFileName.empty() == false)
+	{
+		m_problemsFile.open(m_problemsFileName.c_str(), std::ios::trunc);
+		if (m_problemsFile.is_open() == false)
+		{
+			clog << "Failed to open " << m_problemsFileName << endl;
+			return false;
+		}
+	}
+
+	m_stop = false;
+	if (pthread_create(&m_threadId, NULL, writer_thread, NULL) != 0)
+	{
+		// Write synchronously
+		clog << "Failed to start log writer thread" << endl;
+		return true;
+	}
+	m_started = true;
+
+	return true;
+}
+
+void Logger::stop(void)
+{
+	summarize();
+
+	pthread_mutex_lock(&m_mutex);
+	bool started = m_started;
+	m_stop = true;
+	pthread_cond_signal(&m_pendingCond);
+	pthread_mutex_unlock(&m_mutex);
+
+	if (started == true)
+	{
+		// Anything still pending is written before the thread exits
+		pthread_join(m_threadId, NULL);
+
+		pthread_mutex_lock(&m_mutex);
+		m_started = false;
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	if (m_problemsFile.is_open() == true)
+	{
+		m_problemsFile.close();
+	}
+}
+
+bool Logger::is_enabled(LogLevel level)
+{
+	return (level <= m_level);
+}
+
+void Logger::log(LogLevel level, const string &message)
+{
+	if (level > m_level)
+	{
+		return;
+	}
+
+	write(message + "\n", "");
+}
+
+void Logger::problem(LogProblem problem, const string &name)
+{
+	if ((problem <= PROBLEM_NONE) ||
+		(problem >= PROBLEM_COUNT))
+	{
+		return;
+	}
+
+	string text, problemText;
+
+	if (m_level >= LOG_LEVEL_INFO)
+	{
+		text = g_problems[problem].m_pPrefix;
+		text += name;
+		text += "\n";
+	}
+	else if (m_level == LOG_LEVEL_WARNING)
+	{
+		// Quiet runs only get a summary
+		pthread_mutex_lock(&m_mutex);
+		++m_problemCounts[problem];
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	if (m_problemsFileName.empty() == false)
+	{
+		problemText = "{\"problem\":\"";
+		problemText += g_problems[problem].m_pName;
+		problemText += "\",\"name\":";
+		append_json_string(name, problemText);
+		problemText += "}\n";
+	}
+
+	if ((text.empty() == false) ||
+		(problemText.empty() == false))
+	{
+		write(text, problemText);
+	}
+}
+
+void Logger::flush(const LogBuffer &logBuffer)
+{
+	for (vector<LogEntry>::const_iterator entryIter = logBuffer.m_entries.begin();
+		entryIter != logBuffer.m_entries.end(); ++entryIter)
+	{
+		if (entryIter->m_problem != PROBLEM_NONE)
+		{
+			problem(entryIter->m_problem, entryIter->m_message);
+		}
+		else
+		{
+			log(entryIter->m_level, entryIter->m_message);
+		}
+	}
+}
+
+void Logger::summarize(void)
+{
+	stringstream textStr;
+
+	pthread_mutex_lock(&m_mutex);
+	for (unsigned int problemNum = PROBLEM_NONE + 1; problemNum < PROBLEM_COUNT; ++problemNum)
+	{
+		if (m_problemCounts[problemNum] == 0)
+		{
+			continue;
+		}
+
+		textStr << g_problems[problemNum].m_pKind << ": " << m_problemCounts[problemNum]
+			<< " " << g_problems[problemNum].m_pNoun << "(s)\n";
+
+		m_problemCounts[problemNum] = 0;
+	}
+	pthread_mutex_unlock(&m_mutex);
+
+	if (textStr.str().empty() == false)
+	{
+		write(textStr.str(), "");
+	}
+}
+
+void *Logger::writer_thread(void *)
+{
+	string text, problemText;
+
+	pthread_mutex_lock(&m_mutex);
+
+	while (true)
+	{
+		if ((m_pending.empty() == false) ||
+			(m_pendingProblems.empty() == false))
+		{
+			// Write without holding the lock, so that loggers don't wait on stderr
+			text.swap(m_pending);
+			problemText.swap(m_pendingProblems);
+			pthread_mutex_unlock(&m_mutex);
+
+			if (text.empty() == false)
+			{
+				clog << text << std::flush;
+				text.clear();
+			}
+			if (problemText.empty() == false)
+			{
+				m_problemsFile << problemText;
+				problemText.clear();
+			}
+
+			pthread_mutex_lock(&m_mutex);
+			continue;
+		}
+		else if (m_stop == true)
+		{
+			break;
+		}
+
+		pthread_cond_wait(&m_pendingCond, &m_mutex);
+	}
+
+	pthread_mutex_unlock(&m_mutex);
+
+	return NULL;
+}
+
+void Logger::write(const string &text,
+	const string &problemText)
+{
+	pthread_mutex_lock(&m_mutex);
+
+	if (m_started == false)
+	{
+		clog << text << std::flush;
+		if (m_problemsFile.is_open() == true)
+		{
+			m_problemsFile << problemText;
+		}
+	}
+	else
+	{
+		bool wasEmpty = (m_pending.empty() == true) && (m_pendingProblems.empty() == true);
+
+		m_pending += text;
+		m_pendingProblems += problemText;
+
+		// The writer thread only waits when there's nothing pending
+		if (wasEmpty == true)
+		{
+			pthread_cond_signal(&m_pendingCond);
+		}
+	}
+
+	pthread_mutex_unlock(&m_mutex);
+}
+
+LogMessage::LogMessage(LogLevel level) :
+	m_level(level),
+	m_enabled(Logger::is_enabled(level))
+{
+}
+
+LogMessage::~LogMessage()
+{
+	if (m_enabled == true)
+	{
+		Logger::log(m_level, m_stream.str());
+	}
+}
+
+LogLevel Logger::m_level = LOG_LEVEL_INFO;
+string Logger::m_problemsFileName;
+bool Logger::m_started = false;
+bool Logger::m_stop = false;
+pthread_t Logger::m_threadId;
+pthread_mutex_t Logger::m_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t Logger::m_pendingCond = PTHREAD_COND_INITIALIZER;
+string Logger::m_pending;
+string Logger::m_pendingProblems;
+ofstream Logger::m_problemsFile;
+unsigned int Logger::m_problemCounts[PROBLEM_COUNT] = { 0 };
@@ -0,0 +1,152 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _LOGGER_H
+#define _LOGGER_H
+
+#include <pthread.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef enum { LOG_LEVEL_ERROR = 0, LOG_LEVEL_WARNING, LOG_LEVEL_INFO, LOG_LEVEL_DEBUG } LogLevel;
+
+// Problems with a given file or album, these are warnings that can be summarized
+typedef enum { PROBLEM_NONE = 0, PROBLEM_MISSING_ARTIST, PROBLEM_MISSING_TITLE, PROBLEM_MISSING_YEAR,
+	PROBLEM_NO_TAGS, PROBLEM_LOAD_FAILED, PROBLEM_OPEN_FAILED, PROBLEM_NOT_AUDIO,
+	PROBLEM_UNKNOWN_TYPE, PROBLEM_UNSUPPORTED_TYPE,
+	PROBLEM_NO_ARTIST_TRACKS, PROBLEM_NO_ALBUM_TRACKS, PROBLEM_COUNT } LogProblem;
+
+class LogEntry
+{
+	public:
+		LogEntry(LogLevel level, const std::string &message,
+			LogProblem problem = PROBLEM_NONE);
+		LogEntry(const LogEntry &other);
+		virtual ~LogEntry();
+
+		LogEntry &operator=(const LogEntry &other);
+
+		LogLevel m_level;
+		std::string m_message;
+		LogProblem m_problem;
+
+};
+
+// Holds what a job logs on a worker thread, until Logger is handed it in the order jobs were pushed.
+// A pass-through buffer hands messages to Logger right away
+class LogBuffer
+{
+	public:
+		LogBuffer(bool passThrough = false);
+		LogBuffer(const LogBuffer &other);
+		virtual ~LogBuffer();
+
+		LogBuffer &operator=(const LogBuffer &other);
+
+		void log(LogLevel level, const std::string &message);
+
+		void problem(LogProblem problem, const std::string &name);
+
+		void append(const LogBuffer &other);
+
+		void clear(void);
+
+		std::vector<LogEntry> m_entries;
+
+	protected:
+		bool m_passThrough;
+
+};
+
+// Writes messages at or below the chosen level to stderr. Once started, messages are queued and
+// a background thread writes them in batches. At the warning level, problems are only counted,
+// and summarized at the end. They may also be recorded to a JSON lines report.
+// Methods may be called from any thread
+class Logger
+{
+	public:
+		static bool start(void);
+
+		static void stop(void);
+
+		static bool is_enabled(LogLevel level);
+
+		static void log(LogLevel level, const std::string &message);
+
+		static void problem(LogProblem problem, const std::string &name);
+
+		static void flush(const LogBuffer &logBuffer);
+
+		static void summarize(void);
+
+		static LogLevel m_level;
+		static std::string m_problemsFileName;
+
+	protected:
+		static bool m_started;
+		static bool m_stop;
+		static pthread_t m_threadId;
+		static pthread_mutex_t m_mutex;
+		static pthread_cond_t m_pendingCond;
+		static std::string m_pending;
+		static std::string m_pendingProblems;
+		static std::ofstream m_problemsFile;
+		static unsigned int m_problemCounts[PROBLEM_COUNT];
+
+		static void *writer_thread(void *pData);
+
+		static void write(const std::string &text,
+			const std::string &problemText);
+
+	private:
+		Logger();
+		Logger(const Logger &other);
+		Logger &operator=(const Logger &other);
+
+};
+
+// Builds a message with operator<< and logs it when it goes out of scope
+class LogMessage
+{
+	public:
+		LogMessage(LogLevel level);
+		~LogMessage();
+
+		template<class T> LogMessage &operator<<(const T &value)
+		{
+			if (m_enabled == true)
+			{
+				m_stream << value;
+			}
+			return *this;
+		}
+
+	protected:
+		LogLevel m_level;
+		bool m_enabled;
+		std::ostringstream m_stream;
+
+	private:
+		LogMessage(const LogMessage &other);
+		LogMessage &operator=(const LogMessage &other);
+
+};
+
+#endif // _LOGGER_H
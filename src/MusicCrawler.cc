@@ -17,150 +17,522 @@
  */
 
 #include <ctype.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #ifdef HAVE_FNMATCH_H
 #include <fnmatch.h>
 #endif
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <algorithm>
 #include <iostream>
 #include <map>
 #include <fstream>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "FolderWatcher.h"
+#include "Logger.h"
 #include "MusicCrawler.h"
+#include "RunStats.h"
+#include "UringReader.h"
 #include "Utilities.h"
 
-using std::clog;
-using std::endl;
+using std::find;
 using std::for_each;
+using std::less;
 using std::map;
+using std::min;
+using std::move;
 using std::ofstream;
 using std::pair;
+using std::set;
 using std::sort;
 using std::string;
 using std::stringstream;
 using std::vector;
 
-// A function object to sort tracks with for_each()
-struct SortTracksFunc
+#ifdef HAVE_SYS_INOTIFY_H
+static volatile sig_atomic_t g_stopWatching = 0;
+
+static void stop_watching(int)
+{
+	g_stopWatching = 1;
+}
+#endif
+
+// A function object to sort a playlist's track indices with sort()
+struct SortTrackIndicesFunc
 {
 	public:
-		bool operator()(const Track &a, const Track &b) const
+		SortTrackIndicesFunc(const vector<Track> &tracks,
+			TrackSort sort) :
+			m_tracks(tracks),
+			m_sort(sort)
+		{
+		}
+
+		bool operator()(unsigned int a, unsigned int b) const
 		{
-			return a < b;
+			return m_tracks[a].is_before(m_tracks[b], m_sort);
 		}
+
+		const vector<Track> &m_tracks;
+		TrackSort m_sort;
+
 };
 
-// Function objects to dump then delete lists of tracks with for_each()
-struct DumpAndDeleteYearTracksVectorFunc
+// A job that sorts then renders a playlist, possibly on a worker thread
+class PlaylistJob : public WorkerJob
 {
 	public:
-		DumpAndDeleteYearTracksVectorFunc(const string &outputDirectory,
-			const string &prefix) :
-			m_outputDirectory(outputDirectory),
-			m_prefix(prefix)
+		PlaylistJob(const string &fileName,
+			const vector<Track> &tracks, const Playlist &playlist) :
+			WorkerJob(),
+			m_fileName(fileName),
+			m_tracks(tracks),
+			m_playlist(playlist)
+		{
+		}
+		virtual ~PlaylistJob()
+		{
+		}
+
+		virtual void run(void)
 		{
+			PhaseTimer sortTimer("sort");
+			m_playlist.sort_tracks(m_tracks);
+			sortTimer.stop();
+
+			PhaseTimer renderTimer("render");
+			Track::render_playlist(m_tracks, m_playlist.m_trackIndices, m_content);
+			renderTimer.stop();
+
+			m_playlist.m_trackIndices.clear();
 		}
 
-		void operator()(pair<int, vector<Track>*> artistTracks)
+		string m_fileName;
+		const vector<Track> &m_tracks;
+		Playlist m_playlist;
+		string m_content;
+		string m_digest;
+
+};
+
+// Writes playlists in the order they are given, whichever worker rendered them first.
+// Playlists whose tracks are the same as recorded in the journal are skipped
+class PlaylistWriter
+{
+	public:
+		PlaylistWriter(unsigned int workersCount,
+			const vector<Track> &tracks, PlaylistJournal *pJournal) :
+			m_tracks(tracks),
+			m_pJournal(pJournal),
+			m_pWorkers(NULL)
+		{
+			if (workersCount > 1)
+			{
+				m_pWorkers = new WorkerPool(workersCount);
+			}
+		}
+		~PlaylistWriter()
 		{
-			if ((artistTracks.first > 0) &&
-				(artistTracks.second->empty() == false))
+			if (m_pWorkers != NULL)
 			{
-				stringstream yearFileNameStr;
+				write_playlists(0);
 
-				yearFileNameStr << m_prefix << artistTracks.first;
+				delete m_pWorkers;
+			}
+		}
 
-				string fileName(clean_file_name(yearFileNameStr.str()));
+		void write(const string &fileName,
+			const Playlist &playlist)
+		{
+			string digest;
 
-				if (fileName.empty() == false)
+			if (m_pJournal != NULL)
+			{
+				digest = playlist.get_digest(m_tracks);
+
+				// The file may have been removed since
+				if ((m_pJournal->has_digest(fileName, digest) == true) &&
+					(access(fileName.c_str(), F_OK) == 0))
 				{
-					if (m_outputDirectory.empty() == false)
-					{
-						fileName.insert(0, m_outputDirectory);
-					}
+					++Track::m_unchangedFilesCount;
+					RunStats::add_count("playlists_unchanged");
+					return;
+				}
+			}
+
+			PlaylistJob *pJob = new PlaylistJob(fileName, m_tracks, playlist);
 
-					// Sort tracks
-					sort(artistTracks.second->begin(), artistTracks.second->end(), SortTracksFunc());
+			pJob->m_digest = digest;
 
-					Track::write_file(fileName, *(artistTracks.second));
+			if (m_pWorkers != NULL)
+			{
+				// Don't hold too many rendered playlists in memory
+				write_playlists(4);
+
+				if (m_pWorkers->push_job(pJob) == true)
+				{
+					return;
 				}
 			}
 
-			delete artistTracks.second;
+			unsigned int filesCount = get_files_count();
+
+			// Sort and write the playlist here
+			PhaseTimer sortTimer("sort");
+			pJob->m_playlist.sort_tracks(m_tracks);
+			sortTimer.stop();
+
+			Track::write_file(fileName, m_tracks, pJob->m_playlist.m_trackIndices);
+			record_digest(pJob, filesCount);
+
+			delete pJob;
+		}
+
+	protected:
+		const vector<Track> &m_tracks;
+		PlaylistJournal *m_pJournal;
+		WorkerPool *m_pWorkers;
+
+		unsigned int get_files_count(void) const
+		{
+			return Track::m_writtenFilesCount + Track::m_unchangedFilesCount;
+		}
+
+		void record_digest(PlaylistJob *pJob, unsigned int filesCount)
+		{
+			// Only record playlists that made it to disk
+			if ((m_pJournal != NULL) &&
+				(get_files_count() > filesCount))
+			{
+				m_pJournal->set_digest(pJob->m_fileName, pJob->m_digest);
+			}
+		}
+
+		void write_playlists(unsigned int maxJobsCount)
+		{
+			WorkerJob *pJob = m_pWorkers->pop_job(m_pWorkers->get_jobs_count() > maxJobsCount);
+			while (pJob != NULL)
+			{
+				PlaylistJob *pPlaylistJob = dynamic_cast<PlaylistJob*>(pJob);
+				unsigned int filesCount = get_files_count();
+
+				Track::write_file(pPlaylistJob->m_fileName, pPlaylistJob->m_content);
+				record_digest(pPlaylistJob, filesCount);
+				delete pJob;
+
+				pJob = m_pWorkers->pop_job(m_pWorkers->get_jobs_count() > maxJobsCount);
+			}
+		}
+
+	private:
+		PlaylistWriter(const PlaylistWriter &other);
+		PlaylistWriter &operator=(const PlaylistWriter &other);
+
+};
+
+static string get_year_file_name(const string &outputDirectory,
+	const string &prefix, int year)
+{
+	stringstream yearFileNameStr;
+
+	yearFileNameStr << prefix << year;
+
+	string fileName(clean_file_name(yearFileNameStr.str()));
+
+	if ((fileName.empty() == false) &&
+		(outputDirectory.empty() == false))
+	{
+		fileName.insert(0, outputDirectory);
+	}
+
+	return fileName;
+}
+
+static string get_artist_file_name(const string &outputDirectory,
+	const vector<Track> &tracks, const Playlist &playlist)
+{
+	if (playlist.m_trackIndices.empty() == true)
+	{
+		return "";
+	}
+
+	// Use the original artist name, not the lower cased key
+	string fileName(clean_file_name(tracks[playlist.m_trackIndices.front()].get_artist()));
+
+	if (fileName.empty() == true)
+	{
+		return "";
+	}
+
+	// Make sure it starts with a capital letter
+	if (islower(fileName[0]) != 0)
+	{
+		char c = (char)toupper(fileName[0]);
+		stringstream fileNameStr;
+
+		fileNameStr << c;
+		fileNameStr << fileName.substr(1);
+
+		fileName = fileNameStr.str();
+	}
+
+	if (outputDirectory.empty() == false)
+	{
+		fileName.insert(0, outputDirectory);
+	}
+
+	return fileName;
+}
+
+// Function objects to dump playlists with for_each()
+struct DumpYearPlaylistFunc
+{
+	public:
+		DumpYearPlaylistFunc(const string &outputDirectory,
+			const string &prefix, PlaylistWriter *pWriter) :
+			m_outputDirectory(outputDirectory),
+			m_prefix(prefix),
+			m_pWriter(pWriter)
+		{
+		}
+
+		void operator()(const pair<const int, Playlist> &yearPlaylist)
+		{
+			if ((yearPlaylist.first > 0) &&
+				(yearPlaylist.second.m_trackIndices.empty() == false))
+			{
+				string fileName(get_year_file_name(m_outputDirectory, m_prefix, yearPlaylist.first));
+
+				if (fileName.empty() == false)
+				{
+					// Tracks are sorted by the writer
+					m_pWriter->write(fileName, yearPlaylist.second);
+				}
+			}
 		}
 
 		string m_outputDirectory;
 		string m_prefix;
+		PlaylistWriter *m_pWriter;
 
 };
 
-struct DumpAndDeleteArtistTracksVectorFunc
+struct DumpArtistPlaylistFunc
 {
 	public:
-		DumpAndDeleteArtistTracksVectorFunc(const string &outputDirectory) :
-			m_outputDirectory(outputDirectory)
+		DumpArtistPlaylistFunc(const string &outputDirectory,
+			const vector<Track> &tracks, PlaylistWriter *pWriter) :
+			m_outputDirectory(outputDirectory),
+			m_tracks(tracks),
+			m_pWriter(pWriter)
 		{
 		}
 
-		void operator()(pair<string, vector<Track>*> artistTracks)
+		void operator()(const pair<const string, Playlist> &artistPlaylist)
 		{
-			if ((artistTracks.first.empty() == false) &&
-				(artistTracks.second->empty() == false))
+			if ((artistPlaylist.first.empty() == false) &&
+				(artistPlaylist.second.m_trackIndices.empty() == false))
 			{
-				// Use the original artist name, not the lower cased key
-				string fileName(clean_file_name(artistTracks.second->begin()->get_artist()));
+				string fileName(get_artist_file_name(m_outputDirectory, m_tracks, artistPlaylist.second));
 
 				if (fileName.empty() == false)
 				{
-					// Make sure it starts with a capital letter
-					if (islower(fileName[0]) != 0)
-					{
-						char c = (char)toupper(fileName[0]);
-						stringstream fileNameStr;
+					// Albums are sorted by year first, by the writer
+					m_pWriter->write(fileName, artistPlaylist.second);
+				}
+			}
+		}
 
-						fileNameStr << c;
-						fileNameStr << fileName.substr(1);
+		string m_outputDirectory;
+		const vector<Track> &m_tracks;
+		PlaylistWriter *m_pWriter;
 
-						fileName = fileNameStr.str();
-					}
+};
 
-					if (m_outputDirectory.empty() == false)
-					{
-						fileName.insert(0, m_outputDirectory);
-					}
+// A job that retrieves a file's tags, possibly on a worker thread
+class TagJob : public WorkerJob
+{
+	public:
+		TagJob(const string &entryName,
+			off_t size, time_t modTime,
+			TagLib::IOStream *pStream) :
+			WorkerJob(),
+			m_entryName(entryName),
+			m_size(size),
+			m_modTime(modTime),
+			m_track(entryName, modTime),
+			m_tagged(false),
+			m_cached(false),
+			m_problem(PROBLEM_NONE),
+			m_pStream(pStream)
+		{
+		}
+		virtual ~TagJob()
+		{
+			close_stream();
+		}
 
-					// Sort albums by year first
-					sort(artistTracks.second->begin(), artistTracks.second->end(), SortTracksFunc());
+		virtual void run(void)
+		{
+			if (m_cached == false)
+			{
+				PhaseTimer tagTimer("tags");
 
-					Track::write_file(fileName, *(artistTracks.second));
+				// Messages are held back until the track is merged
+				m_tagged = m_track.retrieve_tags(m_log, m_pStream);
+				if ((m_tagged == false) &&
+					(m_log.m_entries.empty() == false))
+				{
+					m_problem = m_log.m_entries.back().m_problem;
 				}
+				RunStats::add_file(m_entryName, tagTimer.stop());
 			}
 
-			delete artistTracks.second;
+			close_stream();
 		}
 
-		string m_outputDirectory;
+		void close_stream(void)
+		{
+#ifdef HAVE_LIBURING
+			if (m_pStream != NULL)
+			{
+				delete m_pStream;
+				m_pStream = NULL;
+			}
+#endif
+		}
+
+		string m_entryName;
+		off_t m_size;
+		time_t m_modTime;
+		Track m_track;
+		bool m_tagged;
+		bool m_cached;
+		LogProblem m_problem;
+		LogBuffer m_log;
+		TagLib::IOStream *m_pStream;
 
 };
 
-MusicCrawler::MusicCrawler()
+Playlist::Playlist(TrackSort sort) :
+	m_sort(sort)
+{
+}
+
+Playlist::Playlist(const Playlist &other) :
+	m_sort(other.m_sort),
+	m_trackIndices(other.m_trackIndices)
 {
 }
 
+Playlist::~Playlist()
+{
+}
+
+Playlist &Playlist::operator=(const Playlist &other)
+{
+	if (this != &other)
+	{
+		m_sort = other.m_sort;
+		m_trackIndices = other.m_trackIndices;
+	}
+
+	return *this;
+}
+
+void Playlist::sort_tracks(const vector<Track> &tracks)
+{
+	sort(m_trackIndices.begin(), m_trackIndices.end(), SortTrackIndicesFunc(tracks, m_sort));
+}
+
+bool Playlist::remove_track(unsigned int trackIndex)
+{
+	vector<unsigned int>::iterator indexIter = find(m_trackIndices.begin(), m_trackIndices.end(), trackIndex);
+
+	if (indexIter == m_trackIndices.end())
+	{
+		return false;
+	}
+	m_trackIndices.erase(indexIter);
+
+	return true;
+}
+
+string Playlist::get_digest(const vector<Track> &tracks) const
+{
+	char digestStr[64];
+	uint64_t digest = 0;
+
+	// Summing makes this independent of the order tracks were added in
+	for (vector<unsigned int>::const_iterator indexIter = m_trackIndices.begin();
+		indexIter != m_trackIndices.end(); ++indexIter)
+	{
+		digest += tracks[*indexIter].get_digest(m_sort);
+	}
+	snprintf(digestStr, sizeof(digestStr), "%d-%u-%016llx", (int)m_sort,
+		(unsigned int)m_trackIndices.size(), (unsigned long long)digest);
+
+	return digestStr;
+}
+
+PlaylistChanges::PlaylistChanges() :
+	m_covers(false)
+{
+}
+
+PlaylistChanges::~PlaylistChanges()
+{
+}
+
+bool PlaylistChanges::is_empty(void) const
+{
+	return ((m_years.empty() == true) &&
+		(m_artists.empty() == true) &&
+		(m_covers == false));
+}
+
+MusicCrawler::MusicCrawler() :
+	m_arena(),
+	m_yearTracks(less<int>(), YearPlaylists::allocator_type(get_maps_arena())),
+	m_pJournal(NULL)
+{
+	if (m_journalFileName.empty() == false)
+	{
+		m_pJournal = new PlaylistJournal(m_journalFileName);
+		m_pJournal->load();
+	}
+}
+
 MusicCrawler::~MusicCrawler()
 {
 	if (m_yearTracks.empty() == false)
 	{
-		// Write playlists and free lists up
-		dump_and_delete_tracks(m_yearTracks, "Year ");
+		// Write playlists
+		dump_playlists(m_yearTracks, "Year ");
 	}
+
+	if (m_pJournal != NULL)
+	{
+		m_pJournal->save();
+
+		delete m_pJournal;
+	}
+
+	// Playlists are written last
+	LogMessage(LOG_LEVEL_INFO) << "Wrote " << Track::m_writtenFilesCount << " playlist(s), "
+		<< Track::m_unchangedFilesCount << " were unchanged";
 }
 
 string MusicCrawler::escape_quotes(const string &str)
@@ -182,217 +554,1083 @@ string MusicCrawler::escape_quotes(const string &str)
 	return quotedStr;
 }
 
-void MusicCrawler::dump_and_delete_tracks(map<int, vector<Track>*> tracks,
-	const string &prefix)
+Arena *MusicCrawler::get_maps_arena(void)
 {
-	for_each(tracks.begin(), tracks.end(),
-		DumpAndDeleteYearTracksVectorFunc(m_outputDirectory, prefix));
+	// Watching erases and inserts nodes for as long as it runs, and the arena never gives them back
+	if (MusicFolderCrawler::m_watchDelay > 0)
+	{
+		return NULL;
+	}
+
+	return &m_arena;
 }
 
-string MusicCrawler::m_outputDirectory;
+unsigned int MusicCrawler::add_track(Track &newTrack)
+{
+	// Move the track into the store rather than copy it, the caller is done with it
+	if (m_freeTracks.empty() == false)
+	{
+		unsigned int trackIndex = m_freeTracks.back();
 
-MusicFolderCrawler::MusicFolderCrawler(const string &topLevelDirName) :
-	MusicCrawler(),
-	m_topLevelDirName(topLevelDirName),
-	m_currentDepth(0)
+		// Reuse the slot of a track that was removed
+		m_freeTracks.pop_back();
+		m_tracks[trackIndex] = move(newTrack);
+
+		return trackIndex;
+	}
+
+	unsigned int trackIndex = (unsigned int)m_tracks.size();
+
+	m_tracks.push_back(move(newTrack));
+
+	return trackIndex;
+}
+
+void MusicCrawler::release_track(unsigned int trackIndex)
 {
+	if (trackIndex >= m_tracks.size())
+	{
+		return;
+	}
+
+	m_tracks[trackIndex] = Track("");
+	m_freeTracks.push_back(trackIndex);
 }
 
-MusicFolderCrawler::~MusicFolderCrawler()
+void MusicCrawler::dump_playlists(const YearPlaylists &playlists,
+	const string &prefix, const set<int> *pYears)
 {
-	if (m_artistTracks.empty() == false)
+	PlaylistWriter writer(m_workersCount, m_tracks, m_pJournal);
+	DumpYearPlaylistFunc dumpFunc(m_outputDirectory, prefix, &writer);
+
+	if (pYears == NULL)
 	{
-		// Write playlists and free lists up
-		for_each(m_artistTracks.begin(), m_artistTracks.end(),
-			DumpAndDeleteArtistTracksVectorFunc(m_outputDirectory));
+		for_each(playlists.begin(), playlists.end(), dumpFunc);
+		return;
 	}
 
-	if (m_coverTracks.empty() == false)
+	// Only write these years
+	for (set<int>::const_iterator yearIter = pYears->begin();
+		yearIter != pYears->end(); ++yearIter)
 	{
-		string fileName("Covers");
+		YearPlaylists::const_iterator playlistIter = playlists.find(*yearIter);
+
+		if (playlistIter != playlists.end())
+		{
+			dumpFunc(*playlistIter);
+		}
+	}
+}
 
-		// Sort albums by year first
-		sort(m_coverTracks.begin(), m_coverTracks.end(), SortTracksFunc());
+void MusicCrawler::remove_playlists(const YearPlaylists &playlists,
+	const string &prefix, const set<int> &years)
+{
+	for (set<int>::const_iterator yearIter = years.begin();
+		yearIter != years.end(); ++yearIter)
+	{
+		YearPlaylists::const_iterator playlistIter = playlists.find(*yearIter);
 
-		if (m_outputDirectory.empty() == false)
+		// Years that still have tracks were written again
+		if (((playlistIter == playlists.end()) ||
+			(playlistIter->second.m_trackIndices.empty() == true)) &&
+			(*yearIter > 0))
 		{
-			fileName.insert(0, m_outputDirectory);
+			remove_playlist_file(get_year_file_name(m_outputDirectory, prefix, *yearIter));
 		}
-		Track::write_file(fileName, m_coverTracks);
 	}
 }
 
-void MusicFolderCrawler::crawl(void)
+void MusicCrawler::remove_playlist_file(const string &fileName)
 {
-	if (m_topLevelDirName[m_topLevelDirName.length() - 1] != '/')
+	if (fileName.empty() == true)
 	{
-		m_topLevelDirName += "/";
+		return;
 	}
-	crawl_folder(m_topLevelDirName);
 
-	clog << "Found " << m_artistTracks.size() << " artist(s), across " << m_yearTracks.size() << " year(s)" << endl;
+	// A full run wouldn't write this playlist
+	if (unlink(fileName.c_str()) == 0)
+	{
+		LogMessage(LOG_LEVEL_INFO) << "Removed " << fileName;
+		RunStats::add_count("playlists_removed");
+	}
+	else if (errno != ENOENT)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to remove " << fileName << ": " << strerror(errno);
+	}
 }
 
-void MusicFolderCrawler::record_album_artist(const string &entryName,
-	const string &artist, const string &album)
+string MusicCrawler::m_outputDirectory;
+
+unsigned int MusicCrawler::m_workersCount = 1;
+
+string MusicCrawler::m_journalFileName;
+
+MusicFolderCrawler::MusicFolderCrawler(const string &topLevelDirName) :
+	MusicCrawler(),
+	m_topLevelDirName(topLevelDirName),
+	m_currentDepth(0),
+	m_skippedFilesCount(0),
+	m_crawled(false),
+	m_artistTracks(less<string>(), ArtistPlaylists::allocator_type(get_maps_arena())),
+	m_coverTracks(TRACK_SORT_YEAR),
+	m_pathTracks(less<string>(), PathTracks::allocator_type(get_maps_arena())),
+	m_pChanges(NULL),
+	m_pWorkers(NULL),
+	m_pCache(NULL),
+	m_pUring(NULL)
 {
-	// Nothing to do here
 }
 
-void MusicFolderCrawler::record_track_artist(const Track &newTrack,
-	const string &artist, const string &title, int year)
+MusicFolderCrawler::~MusicFolderCrawler()
 {
-	if (m_identifyCovers == false)
+	if (m_pWorkers != NULL)
 	{
-		// Nothing to do
-		return;
+		delete m_pWorkers;
 	}
-
-#ifdef HAVE_FNMATCH_H
-	// Try and catch "title (artist_name cover)"
-	if (fnmatch("* cover)", title.c_str(), FNM_NOESCAPE) == 0)
+	if (m_pCache != NULL)
 	{
-		m_coverTracks.push_back(newTrack);
+		delete m_pCache;
+	}
+#ifdef HAVE_LIBURING
+	if (m_pUring != NULL)
+	{
+		delete m_pUring;
 	}
 #endif
+
+	if (m_artistTracks.empty() == false)
+	{
+		// Write playlists
+		dump_artist_playlists(NULL);
+	}
+
+	dump_cover_playlist();
 }
 
-void MusicFolderCrawler::crawl_folder(const string &entryName)
+void MusicFolderCrawler::crawl(void)
 {
-	struct stat fileStat;
-	int entryStatus = stat(entryName.c_str(), &fileStat);
+	if (m_topLevelDirName[m_topLevelDirName.length() - 1] != '/')
+	{
+		m_topLevelDirName += "/";
+	}
 
-	if (entryStatus != 0)
+	PhaseTimer crawlTimer("crawl");
+
+	if (m_cacheFileName.empty() == false)
 	{
-		clog << "Unknown type for " << entryName << endl;
+		PhaseTimer cacheTimer("cache");
+
+		m_pCache = new TagCache(m_cacheFileName);
+		m_pCache->load();
 	}
-	else if (S_ISREG(fileStat.st_mode))
+
+	if (m_workersCount > 1)
 	{
-		// FIXME: look up MIME type, make sure it's a music file
-		Track newTrack(entryName, fileStat.st_mtime);
+		m_pWorkers = new WorkerPool(m_workersCount);
+	}
 
-		if (newTrack.retrieve_tags() == false)
+	if (m_uringQueueDepth > 0)
+	{
+#ifdef HAVE_LIBURING
+		m_pUring = new UringReader(m_uringQueueDepth);
+		if (m_pUring->is_ready() == false)
 		{
-			return;
+			delete m_pUring;
+			m_pUring = NULL;
 		}
+#else
+		LogMessage(LOG_LEVEL_WARNING) << "No support for io_uring, crawling synchronously";
+#endif
+	}
+
+	crawl_folder(m_topLevelDirName);
+
+#ifdef HAVE_LIBURING
+	if (m_pUring != NULL)
+	{
+		delete m_pUring;
+		m_pUring = NULL;
+	}
+#endif
+
+	if (m_pWorkers != NULL)
+	{
+		// Wait for all files to be tagged
+		merge_tracks(0);
+
+		delete m_pWorkers;
+		m_pWorkers = NULL;
+	}
+
+	if (m_skippedFilesCount > 0)
+	{
+		LogMessage(LOG_LEVEL_INFO) << "Skipped " << m_skippedFilesCount << " file(s) that aren't audio files";
+	}
+
+	if (m_pCache != NULL)
+	{
+		PhaseTimer cacheTimer("cache");
+
+		m_pCache->save();
+
+		delete m_pCache;
+		m_pCache = NULL;
+	}
+
+	LogMessage(LOG_LEVEL_INFO) << "Found " << m_artistTracks.size() << " artist(s), across " << m_yearTracks.size() << " year(s)";
+
+	m_crawled = true;
+}
+
+void MusicFolderCrawler::watch(void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	if (m_crawled == false)
+	{
+		return;
+	}
+
+	FolderWatcher watcher(m_topLevelDirName);
+
+	if (watcher.is_ready() == false)
+	{
+		return;
+	}
+
+	LogMessage(LOG_LEVEL_INFO) << "Watching " << watcher.get_folders_count() << " folder(s) in " << m_topLevelDirName;
+
+	// Write playlists as they are now
+	write_playlists(NULL);
+	Logger::summarize();
+
+	struct sigaction stopAction;
+
+	// Stop on the next signal, poll() should be interrupted
+	memset(&stopAction, 0, sizeof(struct sigaction));
+	stopAction.sa_handler = stop_watching;
+	sigemptyset(&stopAction.sa_mask);
+	sigaction(SIGINT, &stopAction, NULL);
+	sigaction(SIGTERM, &stopAction, NULL);
+
+	set<string> changedPaths;
+
+	while ((g_stopWatching == 0) &&
+		(watcher.wait_for_changes(m_watchDelay, changedPaths) == true))
+	{
+		unsigned int writtenFilesCount = Track::m_writtenFilesCount;
+		unsigned int unchangedFilesCount = Track::m_unchangedFilesCount;
+
+		LogMessage(LOG_LEVEL_INFO) << "Found " << changedPaths.size() << " changed path(s)";
 
-		string album(to_lower_case(newTrack.get_album()));
-		string artist(to_lower_case(newTrack.get_artist()));
-		string title(to_lower_case(newTrack.get_title()));
-		int year = newTrack.get_year();
-
-		if (album.empty() == true)
+		update_tracks(changedPaths);
+
+		if (m_pJournal != NULL)
 		{
-			album = "Unknown album";
+			m_pJournal->save();
 		}
-		if (artist.empty() == true)
+
+		LogMessage(LOG_LEVEL_INFO) << "Wrote " << Track::m_writtenFilesCount - writtenFilesCount << " playlist(s), "
+			<< Track::m_unchangedFilesCount - unchangedFilesCount << " were unchanged";
+		Logger::summarize();
+	}
+
+	LogMessage(LOG_LEVEL_INFO) << "Stopped watching " << m_topLevelDirName;
+
+	// Playlists are up to date, don't write them again
+	clear_playlists();
+#else
+	LogMessage(LOG_LEVEL_WARNING) << "No support for inotify, not watching " << m_topLevelDirName;
+#endif
+}
+
+void MusicFolderCrawler::write_playlists(const PlaylistChanges *pChanges)
+{
+	if (pChanges == NULL)
+	{
+		dump_artist_playlists(NULL);
+		dump_cover_playlist();
+		dump_playlists(m_yearTracks, "Year ");
+		return;
+	}
+
+	// Only write the playlists tracks were added to or removed from,
+	// and remove those that are now empty or were renamed
+	if (pChanges->m_artists.empty() == false)
+	{
+		dump_artist_playlists(&pChanges->m_artists);
+		remove_artist_playlists(pChanges->m_artistFileNames);
+	}
+	if (pChanges->m_covers == true)
+	{
+		dump_cover_playlist();
+
+		if (m_coverTracks.m_trackIndices.empty() == true)
 		{
-			clog << "Missing artist metadata on " << entryName << endl;
-			return;
+			string fileName("Covers");
+
+			if (m_outputDirectory.empty() == false)
+			{
+				fileName.insert(0, m_outputDirectory);
+			}
+
+			remove_playlist_file(fileName);
 		}
-		if (title.empty() == true)
+	}
+	if (pChanges->m_years.empty() == false)
+	{
+		dump_playlists(m_yearTracks, "Year ", &pChanges->m_years);
+		remove_playlists(m_yearTracks, "Year ", pChanges->m_years);
+	}
+}
+
+void MusicFolderCrawler::clear_playlists(void)
+{
+	m_artistTracks.clear();
+	m_coverTracks.m_trackIndices.clear();
+	m_yearTracks.clear();
+}
+
+void MusicFolderCrawler::dump_artist_playlists(const set<string> *pArtists)
+{
+	PlaylistWriter writer(m_workersCount, m_tracks, m_pJournal);
+	DumpArtistPlaylistFunc dumpFunc(m_outputDirectory, m_tracks, &writer);
+
+	if (pArtists == NULL)
+	{
+		for_each(m_artistTracks.begin(), m_artistTracks.end(), dumpFunc);
+		return;
+	}
+
+	// Only write these artists
+	for (set<string>::const_iterator artistIter = pArtists->begin();
+		artistIter != pArtists->end(); ++artistIter)
+	{
+		ArtistPlaylists::const_iterator playlistIter = m_artistTracks.find(*artistIter);
+
+		if (playlistIter != m_artistTracks.end())
 		{
-			clog << "Missing title metadata on " << entryName << endl;
-			return;
+			dumpFunc(*playlistIter);
 		}
-		if (year == 0)
+	}
+}
+
+void MusicFolderCrawler::remove_artist_playlists(const set<string> &fileNames)
+{
+	set<string> currentFileNames;
+
+	// Playlists of different artists may share a file
+	for (ArtistPlaylists::const_iterator playlistIter = m_artistTracks.begin();
+		playlistIter != m_artistTracks.end(); ++playlistIter)
+	{
+		currentFileNames.insert(get_artist_file_name(m_outputDirectory, m_tracks, playlistIter->second));
+	}
+
+	for (set<string>::const_iterator nameIter = fileNames.begin();
+		nameIter != fileNames.end(); ++nameIter)
+	{
+		if (currentFileNames.find(*nameIter) == currentFileNames.end())
 		{
-			clog << "Missing year metadata on " << entryName << endl;
-			return;
+			remove_playlist_file(*nameIter);
+		}
+	}
+}
+
+void MusicFolderCrawler::dump_cover_playlist(void)
+{
+	if (m_coverTracks.m_trackIndices.empty() == true)
+	{
+		return;
+	}
+
+	PlaylistWriter writer(1, m_tracks, m_pJournal);
+	string fileName("Covers");
+
+	if (m_outputDirectory.empty() == false)
+	{
+		fileName.insert(0, m_outputDirectory);
+	}
+
+	// Albums are sorted by year first, by the writer
+	writer.write(fileName, m_coverTracks);
+}
+
+void MusicFolderCrawler::record_album_artist(const string &entryName,
+	const string &artist, const string &album)
+{
+	// Nothing to do here
+}
+
+void MusicFolderCrawler::record_track_artist(unsigned int trackIndex,
+	const string &artist, const string &title, int year)
+{
+	if (m_identifyCovers == false)
+	{
+		// Nothing to do
+		return;
+	}
+
+#ifdef HAVE_FNMATCH_H
+	// Try and catch "title (artist_name cover)"
+	if (fnmatch("* cover)", title.c_str(), FNM_NOESCAPE) == 0)
+	{
+		m_coverTracks.m_trackIndices.push_back(trackIndex);
+
+		if (m_pChanges != NULL)
+		{
+			m_pChanges->m_covers = true;
+		}
+	}
+#endif
+}
+
+void MusicFolderCrawler::record_track(Track &newTrack,
+	const string &entryName)
+{
+	string album(fold_case(newTrack.get_album()));
+	string artist(fold_case(newTrack.get_artist()));
+	string title(fold_case(newTrack.get_title()));
+	int year = newTrack.get_year();
+
+	if (album.empty() == true)
+	{
+		album = "Unknown album";
+	}
+	if (artist.empty() == true)
+	{
+		Logger::problem(PROBLEM_MISSING_ARTIST, entryName);
+		RunStats::add_count("tracks_missing_metadata");
+		return;
+	}
+	if (title.empty() == true)
+	{
+		Logger::problem(PROBLEM_MISSING_TITLE, entryName);
+		RunStats::add_count("tracks_missing_metadata");
+		return;
+	}
+	if (year == 0)
+	{
+		Logger::problem(PROBLEM_MISSING_YEAR, entryName);
+		RunStats::add_count("tracks_missing_metadata");
+		return;
+	}
+
+	unsigned int trackIndex = add_track(newTrack);
+
+	RunStats::add_count("tracks");
+	YearPlaylists::iterator yearIter = m_yearTracks.find(year);
+
+	if (yearIter == m_yearTracks.end())
+	{
+		LogMessage(LOG_LEVEL_DEBUG) << "Yearly playlist " << year;
+
+		yearIter = m_yearTracks.insert(pair<int, Playlist>(year, Playlist(TRACK_SORT_ALPHA))).first;
+	}
+	yearIter->second.m_trackIndices.push_back(trackIndex);
+
+	// Artist playlists are sorted by year
+	ArtistPlaylists::iterator artistIter = m_artistTracks.find(artist);
+
+	if (artistIter == m_artistTracks.end())
+	{
+		if (Logger::is_enabled(LOG_LEVEL_DEBUG) == true)
+		{
+			Logger::log(LOG_LEVEL_DEBUG, "Artist playlist " + artist);
+		}
+
+		artistIter = m_artistTracks.insert(pair<string, Playlist>(artist, Playlist(TRACK_SORT_YEAR))).first;
+	}
+	artistIter->second.m_trackIndices.push_back(trackIndex);
+
+	// When watching, tracks have to be found again by path
+	if (m_watchDelay > 0)
+	{
+		m_pathTracks[entryName] = trackIndex;
+	}
+	if (m_pChanges != NULL)
+	{
+		m_pChanges->m_years.insert(year);
+		m_pChanges->m_artists.insert(artist);
+	}
+
+	// Record associations
+	record_album_artist(entryName, artist, album);
+	record_track_artist(trackIndex, artist, title, year);
+}
+
+void MusicFolderCrawler::remove_track(const string &entryName)
+{
+	PathTracks::iterator pathIter = m_pathTracks.find(entryName);
+
+	if (pathIter == m_pathTracks.end())
+	{
+		return;
+	}
+
+	unsigned int trackIndex = pathIter->second;
+	const Track &oldTrack = m_tracks[trackIndex];
+	string artist(fold_case(oldTrack.get_artist()));
+	int year = oldTrack.get_year();
+
+	YearPlaylists::iterator yearIter = m_yearTracks.find(year);
+
+	if ((yearIter != m_yearTracks.end()) &&
+		(yearIter->second.remove_track(trackIndex) == true))
+	{
+		if (yearIter->second.m_trackIndices.empty() == true)
+		{
+			m_yearTracks.erase(yearIter);
+		}
+		if (m_pChanges != NULL)
+		{
+			m_pChanges->m_years.insert(year);
 		}
+	}
+
+	ArtistPlaylists::iterator artistIter = m_artistTracks.find(artist);
 
-		map<int, vector<Track>*>::iterator yearIter = m_yearTracks.find(year);
+	if ((artistIter != m_artistTracks.end()) &&
+		(m_pChanges != NULL))
+	{
+		// The file is named after the first track, which may be this one
+		m_pChanges->m_artistFileNames.insert(get_artist_file_name(m_outputDirectory, m_tracks, artistIter->second));
+	}
 
-		if (yearIter == m_yearTracks.end())
+	if ((artistIter != m_artistTracks.end()) &&
+		(artistIter->second.remove_track(trackIndex) == true))
+	{
+		if (artistIter->second.m_trackIndices.empty() == true)
+		{
+			m_artistTracks.erase(artistIter);
+		}
+		if (m_pChanges != NULL)
 		{
-			vector<Track> *pYearTracks = new vector<Track>();
+			m_pChanges->m_artists.insert(artist);
+		}
+	}
+
+	if ((m_coverTracks.remove_track(trackIndex) == true) &&
+		(m_pChanges != NULL))
+	{
+		m_pChanges->m_covers = true;
+	}
+
+	m_pathTracks.erase(pathIter);
+	release_track(trackIndex);
+}
+
+void MusicFolderCrawler::remove_tracks(const string &pathName)
+{
+	string dirName(pathName);
+	vector<string> entryNames;
+
+	if (dirName[dirName.length() - 1] != '/')
+	{
+		dirName += "/";
+	}
+
+	// This may be a file, or a folder with tracks in it
+	for (PathTracks::const_iterator pathIter = m_pathTracks.lower_bound(dirName);
+		(pathIter != m_pathTracks.end()) &&
+		(pathIter->first.compare(0, dirName.length(), dirName) == 0); ++pathIter)
+	{
+		entryNames.push_back(pathIter->first);
+	}
+	entryNames.push_back(pathName);
+
+	for (vector<string>::const_iterator nameIter = entryNames.begin();
+		nameIter != entryNames.end(); ++nameIter)
+	{
+		remove_track(*nameIter);
+	}
+}
+
+void MusicFolderCrawler::update_tracks(const set<string> &changedPaths)
+{
+	PlaylistChanges changes;
+
+	m_pChanges = &changes;
+
+	if (m_workersCount > 1)
+	{
+		m_pWorkers = new WorkerPool(m_workersCount);
+	}
 
-			clog << "Yearly playlist " << year << endl;
+	for (set<string>::const_iterator pathIter = changedPaths.begin();
+		pathIter != changedPaths.end(); ++pathIter)
+	{
+		const string &pathName = *pathIter;
+		string::size_type slashPos = pathName.rfind('/');
+		bool parentChanged = false;
 
-			pYearTracks->push_back(newTrack);
-			m_yearTracks.insert(pair<int, vector<Track>*>(year, pYearTracks));
+		// Folders are crawled whole, skip what's in changed folders
+		while ((slashPos != string::npos) &&
+			(slashPos > 0))
+		{
+			if (changedPaths.find(pathName.substr(0, slashPos)) != changedPaths.end())
+			{
+				parentChanged = true;
+				break;
+			}
+			slashPos = pathName.rfind('/', slashPos - 1);
 		}
-		else if (yearIter->second != NULL)
+		if (parentChanged == true)
 		{
-			yearIter->second->push_back(newTrack);
+			continue;
 		}
 
-		// Switch to sorting by year
-		newTrack.set_sort(TRACK_SORT_YEAR);
+		// Forget about what was there, and look at what's there now
+		remove_tracks(pathName);
 
-		map<string, vector<Track>*>::iterator artistIter = m_artistTracks.find(artist);
+		struct stat fileStat;
 
-		if (artistIter == m_artistTracks.end())
+		if (stat(pathName.c_str(), &fileStat) == 0)
 		{
-			vector<Track> *pArtistTracks = new vector<Track>();
+			// Depth is counted from the top, as when crawling everything
+			m_currentDepth = get_depth(pathName);
+
+			if (S_ISDIR(fileStat.st_mode))
+			{
+				crawl_folder(pathName);
+			}
+			else if ((m_maxDepth == 0) ||
+				(m_currentDepth <= m_maxDepth + 1))
+			{
+				// Files are only crawled if their folder isn't too deep
+				crawl_folder(pathName);
+			}
+			m_currentDepth = 0;
+		}
+	}
+
+	if (m_pWorkers != NULL)
+	{
+		// Wait for all files to be tagged
+		merge_tracks(0);
 
-			clog << "Artist playlist " << artist << endl;
+		delete m_pWorkers;
+		m_pWorkers = NULL;
+	}
+
+	m_pChanges = NULL;
 
-			pArtistTracks->push_back(newTrack);
-			m_artistTracks.insert(pair<string, vector<Track>*>(artist, pArtistTracks));
+	if (changes.is_empty() == false)
+	{
+		write_playlists(&changes);
+	}
+}
+
+unsigned int MusicFolderCrawler::get_depth(const string &pathName) const
+{
+	unsigned int depth = 0;
+
+	if (pathName.compare(0, m_topLevelDirName.length(), m_topLevelDirName) != 0)
+	{
+		return 0;
+	}
+
+	// Count the components below the top-level directory
+	string::size_type slashPos = m_topLevelDirName.length() - 1;
+	while (slashPos != string::npos)
+	{
+		if ((slashPos + 1 < pathName.length()) &&
+			(pathName[slashPos + 1] != '/'))
+		{
+			++depth;
 		}
-		else if (artistIter->second != NULL)
+		slashPos = pathName.find('/', slashPos + 1);
+	}
+
+	return depth;
+}
+
+void MusicFolderCrawler::merge_track(TagJob *pJob)
+{
+	if (pJob == NULL)
+	{
+		return;
+	}
+
+	Logger::flush(pJob->m_log);
+
+	// Files without tags or that aren't audio files are cached too so that they aren't opened again.
+	// Those that failed to open or load may do better next time
+	if ((m_pCache != NULL) &&
+		(pJob->m_cached == false) &&
+		((pJob->m_tagged == true) ||
+		(pJob->m_problem == PROBLEM_NO_TAGS) ||
+		(pJob->m_problem == PROBLEM_NOT_AUDIO)))
+	{
+		m_pCache->set_tags(pJob->m_entryName, pJob->m_size, pJob->m_modTime,
+			pJob->m_track, pJob->m_tagged, pJob->m_problem);
+	}
+
+	if (pJob->m_tagged == true)
+	{
+		RunStats::add_count("files_tagged");
+		record_track(pJob->m_track, pJob->m_entryName);
+	}
+	else
+	{
+		RunStats::add_count("files_rejected");
+	}
+}
+
+void MusicFolderCrawler::merge_tracks(unsigned int maxJobsCount)
+{
+	if (m_pWorkers == NULL)
+	{
+		return;
+	}
+
+	// Tracks are merged in the order their files were found, whichever worker tagged them first
+	WorkerJob *pJob = m_pWorkers->pop_job(m_pWorkers->get_jobs_count() > maxJobsCount);
+	while (pJob != NULL)
+	{
+		merge_track(dynamic_cast<TagJob*>(pJob));
+		delete pJob;
+
+		pJob = m_pWorkers->pop_job(m_pWorkers->get_jobs_count() > maxJobsCount);
+	}
+}
+
+void MusicFolderCrawler::crawl_file(const string &entryName,
+	const struct stat &fileStat, TagLib::IOStream *pStream)
+{
+	RunStats::add_count("files_seen");
+
+	// Don't bother opening files that aren't audio files
+	if (Track::is_audio_file(entryName) == false)
+	{
+		++m_skippedFilesCount;
+		RunStats::add_count("files_skipped");
+#ifdef HAVE_LIBURING
+		if (pStream != NULL)
 		{
-			artistIter->second->push_back(newTrack);
+			delete pStream;
 		}
+#endif
+		return;
+	}
 
-		// Record associations
-		record_album_artist(entryName, artist, album);
-		record_track_artist(newTrack, artist, title, year);
+	TagJob *pJob = new TagJob(entryName, fileStat.st_size, fileStat.st_mtime, pStream);
+
+	if ((m_pCache != NULL) &&
+		(m_pCache->get_tags(entryName, fileStat.st_size, fileStat.st_mtime,
+			pJob->m_track, pJob->m_tagged, pJob->m_problem) == true))
+	{
+		pJob->m_cached = true;
+		// Report it like the first time around
+		if (pJob->m_problem != PROBLEM_NONE)
+		{
+			pJob->m_log.problem(pJob->m_problem, entryName);
+		}
+		pJob->close_stream();
+		RunStats::add_count("files_cached");
 	}
-	else if (S_ISDIR(fileStat.st_mode))
+
+	if (m_pWorkers != NULL)
 	{
-		// Is this too deep?
-		if ((m_maxDepth != 0) &&
-            (m_currentDepth > m_maxDepth))
+		// Don't let too many files queue up
+		merge_tracks(m_workersCount * 32);
+
+		// Even cached tracks go through the queue so that they are merged in order
+		if (m_pWorkers->push_job(pJob) == true)
 		{
-			clog << "Directory " << entryName << " is too deep, at depth " << m_currentDepth << endl;
 			return;
 		}
+	}
+
+	// Tag the file here
+	pJob->run();
+	merge_track(pJob);
+
+	delete pJob;
+}
+
+void MusicFolderCrawler::crawl_directory(int parentFd,
+	const char *pDirName, string &entryName)
+{
+	// Is this too deep?
+	if ((m_maxDepth != 0) &&
+		(m_currentDepth > m_maxDepth))
+	{
+		LogMessage(LOG_LEVEL_WARNING) << "Directory " << entryName << " is too deep, at depth " << m_currentDepth;
+		return;
+	}
 
-		// Open the directory
-		DIR *pDir = opendir(entryName.c_str());
-		if (pDir == NULL)
+	// Open the directory relative to its parent, the descriptor is kept open while it's crawled
+	int dirFd = openat(parentFd, pDirName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirFd < 0)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to open directory " << entryName;
+		return;
+	}
+
+	string::size_type entryNameLength = entryName.length();
+#ifdef HAVE_LIBURING
+	vector<UringEntry> uringEntries;
+#endif
+
+	if (entryName[entryNameLength - 1] != '/')
+	{
+		entryName += "/";
+	}
+
+	++m_currentDepth;
+	RunStats::add_count("directories");
+
+	PhaseTimer walkTimer("walk");
+#ifdef HAVE_GETDENTS64
+	// Read entries in large batches
+	vector<char> entriesBuffer(65536);
+	ssize_t bytesCount = getdents64(dirFd, &entriesBuffer[0], entriesBuffer.size());
+
+	walkTimer.stop();
+
+	while (bytesCount > 0)
+	{
+		for (ssize_t entryPos = 0; entryPos < bytesCount; )
 		{
-			clog << "Failed to open directory " << entryName << endl;
-			return;
+			struct dirent64 *pDirEntry = (struct dirent64 *)&entriesBuffer[entryPos];
+
+#ifdef HAVE_LIBURING
+			// With io_uring, entries are stat'ed and read in batches once they are all known
+			if (m_pUring != NULL)
+			{
+				if (pDirEntry->d_name[0] != '.')
+				{
+					uringEntries.push_back(UringEntry(pDirEntry->d_name, pDirEntry->d_type));
+				}
+			}
+			else
+#endif
+			crawl_entry(dirFd, pDirEntry->d_name, pDirEntry->d_type, entryName);
+
+			entryPos += pDirEntry->d_reclen;
 		}
 
-		++m_currentDepth;
+		walkTimer.start();
+		bytesCount = getdents64(dirFd, &entriesBuffer[0], entriesBuffer.size());
+		walkTimer.stop();
+	}
+
+	if (bytesCount < 0)
+	{
+		// What was read so far is still crawled
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to read directory " << entryName << ": " << strerror(errno);
+	}
+
+#ifdef HAVE_LIBURING
+	crawl_entries(dirFd, uringEntries, entryName);
+#endif
 
+	close(dirFd);
+#else
+	DIR *pDir = fdopendir(dirFd);
+	if (pDir == NULL)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to open directory " << entryName;
+		close(dirFd);
+	}
+	else
+	{
 		// Iterate through this directory's entries
 		struct dirent *pDirEntry = readdir(pDir);
+		walkTimer.stop();
 		while (pDirEntry != NULL)
 		{
-			char *pEntryName = pDirEntry->d_name;
-
-			// Skip . .. and dotfiles
-			if ((pEntryName != NULL) &&
-				(pEntryName[0] != '.'))
+#ifdef HAVE_LIBURING
+			// With io_uring, entries are stat'ed and read in batches once they are all known
+			if (m_pUring != NULL)
 			{
-				string subEntryName(entryName);
-
-				if (subEntryName[subEntryName.length() - 1] != '/')
+				if (pDirEntry->d_name[0] != '.')
 				{
-					subEntryName += "/";
+					uringEntries.push_back(UringEntry(pDirEntry->d_name, pDirEntry->d_type));
 				}
-				subEntryName += pEntryName;
-
-				// Crawl this
-				crawl_folder(subEntryName);
 			}
+			else
+#endif
+			crawl_entry(dirFd, pDirEntry->d_name, pDirEntry->d_type, entryName);
 
 			// Next entry
+			walkTimer.start();
 			pDirEntry = readdir(pDir);
+			walkTimer.stop();
 		}
 
+#ifdef HAVE_LIBURING
+		crawl_entries(dirFd, uringEntries, entryName);
+#endif
+
 		closedir(pDir);
+	}
+#endif
+
+	--m_currentDepth;
+
+	entryName.resize(entryNameLength);
+}
+
+void MusicFolderCrawler::crawl_entry(int dirFd,
+	const char *pEntryName, unsigned char entryType,
+	string &entryName)
+{
+	// Skip . .. and dotfiles
+	if ((pEntryName == NULL) ||
+		(pEntryName[0] == '.'))
+	{
+		return;
+	}
+
+	string::size_type entryNameLength = entryName.length();
+
+	entryName += pEntryName;
+
+	// Trust the type reported by the file system, if any
+	if (entryType == DT_DIR)
+	{
+		crawl_directory(dirFd, pEntryName, entryName);
+	}
+	else
+	{
+		struct stat fileStat;
+
+		PhaseTimer statTimer("stat");
+
+		// Links are followed
+		int entryStatus = fstatat(dirFd, pEntryName, &fileStat, 0);
+
+		statTimer.stop();
+
+		crawl_stat_entry(dirFd, pEntryName, entryStatus, fileStat, entryName, NULL);
+	}
+
+	entryName.resize(entryNameLength);
+}
+
+void MusicFolderCrawler::crawl_stat_entry(int dirFd,
+	const char *pEntryName, int entryStatus,
+	const struct stat &fileStat, string &entryName,
+	TagLib::IOStream *pStream)
+{
+	if (entryStatus != 0)
+	{
+		Logger::problem(PROBLEM_UNKNOWN_TYPE, entryName);
+	}
+	else if (S_ISREG(fileStat.st_mode))
+	{
+		crawl_file(entryName, fileStat, pStream);
+		return;
+	}
+	else if (S_ISDIR(fileStat.st_mode))
+	{
+		crawl_directory(dirFd, pEntryName, entryName);
+	}
+	else
+	{
+		Logger::problem(PROBLEM_UNSUPPORTED_TYPE, entryName);
+	}
+
+#ifdef HAVE_LIBURING
+	if (pStream != NULL)
+	{
+		delete pStream;
+	}
+#endif
+}
+
+#ifdef HAVE_LIBURING
+void MusicFolderCrawler::crawl_entries(int dirFd,
+	vector<UringEntry> &entries, string &entryName)
+{
+	if ((m_pUring == NULL) ||
+		(entries.empty() == true))
+	{
+		return;
+	}
+
+	size_t batchSize = m_pUring->get_queue_depth();
+
+	for (size_t firstEntry = 0; firstEntry < entries.size(); firstEntry += batchSize)
+	{
+		size_t lastEntry = min(firstEntry + batchSize, entries.size());
+		string::size_type entryNameLength = entryName.length();
+
+		PhaseTimer statTimer("stat");
+		m_pUring->stat_entries(dirFd, entries, firstEntry, batchSize);
+		statTimer.stop();
+
+		// Only read the header of files that need tagging
+		for (size_t entryNum = firstEntry; entryNum < lastEntry; ++entryNum)
+		{
+			UringEntry &entry = entries[entryNum];
+
+			if ((entry.m_statStatus == 0) &&
+				(S_ISREG(entry.m_stat.st_mode)))
+			{
+				entryName += entry.m_name;
+				entry.m_readHeader = ((Track::is_audio_file(entryName) == true) &&
+					((m_pCache == NULL) ||
+					(m_pCache->has_tags(entryName, entry.m_stat.st_size, entry.m_stat.st_mtime) == false)));
+				entryName.resize(entryNameLength);
+			}
+		}
+
+		PhaseTimer readTimer("read");
+		m_pUring->read_headers(dirFd, entries, firstEntry, batchSize);
+		readTimer.stop();
+
+		for (size_t entryNum = firstEntry; entryNum < lastEntry; ++entryNum)
+		{
+			UringEntry &entry = entries[entryNum];
+
+			// Fall back to crawling synchronously if io_uring failed
+			if (m_pUring->is_ready() == false)
+			{
+				crawl_entry(dirFd, entry.m_name.c_str(), entry.m_type, entryName);
+				continue;
+			}
+
+			entryName += entry.m_name;
+
+			if (entry.m_type == DT_DIR)
+			{
+				crawl_directory(dirFd, entry.m_name.c_str(), entryName);
+			}
+			else
+			{
+				crawl_stat_entry(dirFd, entry.m_name.c_str(), entry.m_statStatus,
+					entry.m_stat, entryName, entry.release_stream(entryName));
+			}
+
+			entryName.resize(entryNameLength);
+		}
+	}
+}
+#endif
+
+void MusicFolderCrawler::crawl_folder(const string &entryName)
+{
+	struct stat fileStat;
+	int entryStatus = stat(entryName.c_str(), &fileStat);
 
-		--m_currentDepth;
+	if (entryStatus != 0)
+	{
+		Logger::problem(PROBLEM_UNKNOWN_TYPE, entryName);
+	}
+	else if (S_ISREG(fileStat.st_mode))
+	{
+		crawl_file(entryName, fileStat, NULL);
+	}
+	else if (S_ISDIR(fileStat.st_mode))
+	{
+		string dirName(entryName);
+
+		crawl_directory(AT_FDCWD, entryName.c_str(), dirName);
 	}
 	else
 	{
-		clog << "Unsupported type for " << entryName << endl;
+		Logger::problem(PROBLEM_UNSUPPORTED_TYPE, entryName);
 	}
 }
 
@@ -400,3 +1638,9 @@ unsigned int MusicFolderCrawler::m_maxDepth = 0;
 
 bool MusicFolderCrawler::m_identifyCovers = false;
 
+string MusicFolderCrawler::m_cacheFileName;
+
+unsigned int MusicFolderCrawler::m_uringQueueDepth = 0;
+
+unsigned int MusicFolderCrawler::m_watchDelay = 0;
+
@@ -19,11 +19,72 @@
 #ifndef _MUSIC_CRAWLER_H
 #define _MUSIC_CRAWLER_H
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 
+#include "PlaylistJournal.h"
+#include "TagCache.h"
 #include "Track.h"
+#include "Utilities.h"
+#include "WorkerPool.h"
+
+class TagJob;
+class UringEntry;
+class UringReader;
+
+// A playlist is a list of indices into the crawler's track store, and how to sort them
+class Playlist
+{
+	public:
+		Playlist(TrackSort sort = TRACK_SORT_ALPHA);
+		Playlist(const Playlist &other);
+		~Playlist();
+
+		Playlist &operator=(const Playlist &other);
+
+		void sort_tracks(const std::vector<Track> &tracks);
+
+		bool remove_track(unsigned int trackIndex);
+
+		std::string get_digest(const std::vector<Track> &tracks) const;
+
+		TrackSort m_sort;
+		std::vector<unsigned int> m_trackIndices;
+
+};
+
+// Playlists that need writing again after tracks changed
+class PlaylistChanges
+{
+	public:
+		PlaylistChanges();
+		~PlaylistChanges();
+
+		bool is_empty(void) const;
+
+		std::set<int> m_years;
+		std::set<std::string> m_artists;
+		// Where artist playlists were, before tracks were removed from them
+		std::set<std::string> m_artistFileNames;
+		bool m_covers;
+
+	private:
+		PlaylistChanges(const PlaylistChanges &other);
+		PlaylistChanges &operator=(const PlaylistChanges &other);
+
+};
+
+// Maps of playlists are allocated from the crawler's arena, unless watching
+typedef std::map<int, Playlist, std::less<int>,
+	ArenaAllocator<std::pair<const int, Playlist> > > YearPlaylists;
+typedef std::map<std::string, Playlist, std::less<std::string>,
+	ArenaAllocator<std::pair<const std::string, Playlist> > > ArtistPlaylists;
+typedef std::map<std::string, unsigned int, std::less<std::string>,
+	ArenaAllocator<std::pair<const std::string, unsigned int> > > PathTracks;
 
 class MusicCrawler
 {
@@ -34,14 +95,34 @@ class MusicCrawler
 		virtual void crawl(void) = 0;
 
 		static std::string m_outputDirectory;
+		static unsigned int m_workersCount;
+		static std::string m_journalFileName;
 
 	protected:
-		std::map<int, std::vector<Track>*> m_yearTracks;
+		// Data that lives as long as the crawler, it must be declared first
+		Arena m_arena;
+		std::vector<Track> m_tracks;
+		std::vector<unsigned int> m_freeTracks;
+		YearPlaylists m_yearTracks;
+		PlaylistJournal *m_pJournal;
 
 		static std::string escape_quotes(const std::string &str);
 
-		void dump_and_delete_tracks(std::map<int, std::vector<Track>*> tracks,
-			const std::string &prefix);
+		Arena *get_maps_arena(void);
+
+		unsigned int add_track(Track &newTrack);
+
+		void release_track(unsigned int trackIndex);
+
+		void dump_playlists(const YearPlaylists &playlists,
+			const std::string &prefix,
+			const std::set<int> *pYears = NULL);
+
+		void remove_playlists(const YearPlaylists &playlists,
+			const std::string &prefix,
+			const std::set<int> &years);
+
+		void remove_playlist_file(const std::string &fileName);
 
 	private:
 		MusicCrawler(const MusicCrawler &other);
@@ -57,22 +138,77 @@ class MusicFolderCrawler : public MusicCrawler
 
 		virtual void crawl(void);
 
+		void watch(void);
+
 		static unsigned int m_maxDepth;
 		static bool m_identifyCovers;
+		static std::string m_cacheFileName;
+		static unsigned int m_uringQueueDepth;
+		static unsigned int m_watchDelay;
 
 	protected:
 		std::string m_topLevelDirName;
 		unsigned int m_currentDepth;
-		std::map<std::string, std::vector<Track>*> m_artistTracks;
-		std::vector<Track> m_coverTracks;
+		unsigned int m_skippedFilesCount;
+		bool m_crawled;
+		ArtistPlaylists m_artistTracks;
+		Playlist m_coverTracks;
+		PathTracks m_pathTracks;
+		PlaylistChanges *m_pChanges;
+		WorkerPool *m_pWorkers;
+		TagCache *m_pCache;
+		UringReader *m_pUring;
+
+		virtual void write_playlists(const PlaylistChanges *pChanges);
+
+		virtual void clear_playlists(void);
+
+		void dump_artist_playlists(const std::set<std::string> *pArtists);
+
+		void remove_artist_playlists(const std::set<std::string> &fileNames);
+
+		void dump_cover_playlist(void);
 
 		virtual void record_album_artist(const std::string &entryName,
 			const std::string &artist, const std::string &album);
 
-		virtual void record_track_artist(const Track &newTrack,
+		virtual void record_track_artist(unsigned int trackIndex,
 			const std::string &artist, const std::string &title,
 			int year);
 
+		void record_track(Track &newTrack,
+			const std::string &entryName);
+
+		virtual void remove_track(const std::string &entryName);
+
+		void remove_tracks(const std::string &pathName);
+
+		void update_tracks(const std::set<std::string> &changedPaths);
+
+		unsigned int get_depth(const std::string &pathName) const;
+
+		void merge_track(TagJob *pJob);
+
+		void merge_tracks(unsigned int maxJobsCount);
+
+		void crawl_file(const std::string &entryName,
+			const struct stat &fileStat, TagLib::IOStream *pStream);
+
+		void crawl_directory(int parentFd,
+			const char *pDirName, std::string &entryName);
+
+		void crawl_entry(int dirFd,
+			const char *pEntryName, unsigned char entryType,
+			std::string &entryName);
+
+		void crawl_stat_entry(int dirFd,
+			const char *pEntryName, int entryStatus,
+			const struct stat &fileStat, std::string &entryName,
+			TagLib::IOStream *pStream);
+
+		void crawl_entries(int dirFd,
+			std::vector<UringEntry> &entries, std::string &entryName);
+
 		void crawl_folder(const std::string &entryName);
 
 	private:
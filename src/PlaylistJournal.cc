@@ -0,0 +1,191 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "Logger.h"
+#include "PlaylistJournal.h"
+#include "Utilities.h"
+
+using std::getline;
+using std::ifstream;
+using std::map;
+using std::ofstream;
+using std::string;
+using std::vector;
+
+static const char *g_journalHeader = "# mppl playlist journal 1";
+
+PlaylistJournalEntry::PlaylistJournalEntry() :
+	m_used(false)
+{
+}
+
+PlaylistJournalEntry::PlaylistJournalEntry(const PlaylistJournalEntry &other) :
+	m_digest(other.m_digest),
+	m_used(other.m_used)
+{
+}
+
+PlaylistJournalEntry::~PlaylistJournalEntry()
+{
+}
+
+PlaylistJournalEntry &PlaylistJournalEntry::operator=(const PlaylistJournalEntry &other)
+{
+	if (this != &other)
+	{
+		m_digest = other.m_digest;
+		m_used = other.m_used;
+	}
+
+	return *this;
+}
+
+PlaylistJournal::PlaylistJournal(const string &fileName) :
+	m_fileName(fileName),
+	m_hitsCount(0),
+	m_missesCount(0)
+{
+}
+
+PlaylistJournal::~PlaylistJournal()
+{
+}
+
+bool PlaylistJournal::load(void)
+{
+	ifstream inputFile;
+	string line;
+
+	inputFile.open(m_fileName.c_str());
+	if (inputFile.good() == false)
+	{
+		LogMessage(LOG_LEVEL_INFO) << "No playlist journal at " << m_fileName;
+		return false;
+	}
+
+	// Ignore journals written in another format
+	if ((getline(inputFile, line).fail() == true) ||
+		(line != g_journalHeader))
+	{
+		LogMessage(LOG_LEVEL_WARNING) << "Ignoring playlist journal " << m_fileName;
+		return false;
+	}
+
+	while (getline(inputFile, line).fail() == false)
+	{
+		vector<string> fields;
+
+		split_line(line, fields);
+		if (fields.size() != 2)
+		{
+			continue;
+		}
+
+		m_entries[unescape_field(fields[0])].m_digest = fields[1];
+	}
+
+	LogMessage(LOG_LEVEL_INFO) << "Loaded " << m_entries.size() << " entries from playlist journal " << m_fileName;
+
+	return true;
+}
+
+bool PlaylistJournal::save(void)
+{
+	string tmpFileName(m_fileName + ".tmp");
+	ofstream outputFile;
+
+	if ((m_hitsCount == 0) &&
+		(m_missesCount == 0))
+	{
+		// No playlist was looked up, keep the journal as it is
+		return true;
+	}
+
+	LogMessage(LOG_LEVEL_INFO) << "Playlist journal had " << m_hitsCount << " hit(s), " << m_missesCount << " miss(es)";
+
+	outputFile.open(tmpFileName.c_str());
+	if (outputFile.good() == false)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write to " << tmpFileName;
+		return false;
+	}
+
+	outputFile << g_journalHeader << "\n";
+
+	// Playlists that weren't written during this run are dropped
+	for (map<string, PlaylistJournalEntry>::const_iterator entryIter = m_entries.begin();
+		entryIter != m_entries.end(); ++entryIter)
+	{
+		if (entryIter->second.m_used == false)
+		{
+			continue;
+		}
+
+		outputFile << escape_field(entryIter->first) << '\t'
+			<< entryIter->second.m_digest << "\n";
+	}
+
+	outputFile.close();
+	if (outputFile.fail() == true)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write to " << tmpFileName;
+		return false;
+	}
+
+	// Don't leave a truncated journal behind
+	if (rename(tmpFileName.c_str(), m_fileName.c_str()) != 0)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to rename " << tmpFileName << " to " << m_fileName;
+		return false;
+	}
+
+	return true;
+}
+
+bool PlaylistJournal::has_digest(const string &playlistFileName,
+	const string &digest)
+{
+	map<string, PlaylistJournalEntry>::iterator entryIter = m_entries.find(playlistFileName);
+
+	if ((entryIter == m_entries.end()) ||
+		(entryIter->second.m_digest != digest))
+	{
+		++m_missesCount;
+		return false;
+	}
+
+	entryIter->second.m_used = true;
+	++m_hitsCount;
+
+	return true;
+}
+
+void PlaylistJournal::set_digest(const string &playlistFileName,
+	const string &digest)
+{
+	PlaylistJournalEntry &entry = m_entries[playlistFileName];
+
+	entry.m_digest = digest;
+	entry.m_used = true;
+}
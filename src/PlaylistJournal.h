@@ -0,0 +1,68 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PLAYLIST_JOURNAL_H
+#define _PLAYLIST_JOURNAL_H
+
+#include <string>
+#include <map>
+
+class PlaylistJournalEntry
+{
+	public:
+		PlaylistJournalEntry();
+		PlaylistJournalEntry(const PlaylistJournalEntry &other);
+		virtual ~PlaylistJournalEntry();
+
+		PlaylistJournalEntry &operator=(const PlaylistJournalEntry &other);
+
+		std::string m_digest;
+		bool m_used;
+
+};
+
+// Digests of the tracks of playlists written by previous runs, keyed by playlist file name
+class PlaylistJournal
+{
+	public:
+		PlaylistJournal(const std::string &fileName);
+		virtual ~PlaylistJournal();
+
+		bool load(void);
+
+		bool save(void);
+
+		bool has_digest(const std::string &playlistFileName,
+			const std::string &digest);
+
+		void set_digest(const std::string &playlistFileName,
+			const std::string &digest);
+
+	protected:
+		std::string m_fileName;
+		std::map<std::string, PlaylistJournalEntry> m_entries;
+		unsigned int m_hitsCount;
+		unsigned int m_missesCount;
+
+	private:
+		PlaylistJournal(const PlaylistJournal &other);
+		PlaylistJournal &operator=(const PlaylistJournal &other);
+
+};
+
+#endif // _PLAYLIST_JOURNAL_H
@@ -0,0 +1,149 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <sstream>
+
+#include "PlaylistScanner.h"
+
+using std::string;
+using std::stringstream;
+
+PlaylistScanner::PlaylistScanner(const char *pData, off_t length,
+	LogBuffer &logBuffer) :
+	m_pData(pData),
+	m_pEnd(pData + length),
+	m_logBuffer(logBuffer),
+	m_lineNumber(0)
+{
+}
+
+PlaylistScanner::~PlaylistScanner()
+{
+}
+
+bool PlaylistScanner::read_header(void)
+{
+	const char *pLine = NULL;
+	size_t lineLength = 0;
+
+	if (next_line(pLine, lineLength) == false)
+	{
+		m_logBuffer.log(LOG_LEVEL_WARNING, "Expected #EXTM3U at line 1, found nothing");
+		return false;
+	}
+
+	// Skip the byte order mark some editors add
+	if ((lineLength >= 3) &&
+		(memcmp(pLine, "\xEF\xBB\xBF", 3) == 0))
+	{
+		pLine += 3;
+		lineLength -= 3;
+	}
+
+	if ((lineLength < 7) ||
+		(memcmp(pLine, "#EXTM3U", 7) != 0))
+	{
+		m_logBuffer.log(LOG_LEVEL_WARNING, "Expected #EXTM3U at line 1, found " + string(pLine, (lineLength < 7 ? lineLength : 7)));
+		return false;
+	}
+
+	return true;
+}
+
+bool PlaylistScanner::next_track(string &trackPath, string &trackName)
+{
+	const char *pLine = NULL;
+	size_t lineLength = 0;
+
+	trackName.clear();
+
+	while (next_line(pLine, lineLength) == true)
+	{
+		if (lineLength == 0)
+		{
+			continue;
+		}
+		else if ((lineLength >= 8) &&
+			(memcmp(pLine, "#EXTINF:", 8) == 0))
+		{
+			const char *pComma = (const char *)memchr(pLine, ',', lineLength);
+
+			// The track name is optional
+			if ((pComma == NULL) ||
+				(pComma + 1 >= pLine + lineLength))
+			{
+				stringstream messageStr;
+
+				messageStr << "Expected comma at line " << m_lineNumber;
+				m_logBuffer.log(LOG_LEVEL_WARNING, messageStr.str());
+				trackName.clear();
+			}
+			else
+			{
+				trackName.assign(pComma + 1, pLine + lineLength - pComma - 1);
+			}
+			continue;
+		}
+		else if (pLine[0] == '#')
+		{
+			// Other directives and comments
+			continue;
+		}
+
+		// This should be a track path, with or without info
+		trackPath.assign(pLine, lineLength);
+
+		return true;
+	}
+
+	return false;
+}
+
+bool PlaylistScanner::next_line(const char *&pLine, size_t &lineLength)
+{
+	if (m_pData >= m_pEnd)
+	{
+		return false;
+	}
+
+	const char *pLineEnd = m_pData;
+
+	while ((pLineEnd < m_pEnd) &&
+		(*pLineEnd != '\n') &&
+		(*pLineEnd != '\r'))
+	{
+		++pLineEnd;
+	}
+
+	pLine = m_pData;
+	lineLength = (size_t)(pLineEnd - m_pData);
+	++m_lineNumber;
+
+	// A \r\n pair ends a single line
+	if ((pLineEnd < m_pEnd) &&
+		(*pLineEnd == '\r') &&
+		(pLineEnd + 1 < m_pEnd) &&
+		(pLineEnd[1] == '\n'))
+	{
+		++pLineEnd;
+	}
+	m_pData = (pLineEnd < m_pEnd ? pLineEnd + 1 : m_pEnd);
+
+	return true;
+}
@@ -0,0 +1,53 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PLAYLIST_SCANNER_H
+#define _PLAYLIST_SCANNER_H
+
+#include <sys/types.h>
+#include <string>
+
+#include "Logger.h"
+
+// Goes through a M3U8 playlist in memory one entry at a time, lines may end with \r, \n or \r\n
+class PlaylistScanner
+{
+	public:
+		PlaylistScanner(const char *pData, off_t length,
+			LogBuffer &logBuffer);
+		virtual ~PlaylistScanner();
+
+		bool read_header(void);
+
+		bool next_track(std::string &trackPath, std::string &trackName);
+
+	protected:
+		const char *m_pData;
+		const char *m_pEnd;
+		LogBuffer &m_logBuffer;
+		unsigned int m_lineNumber;
+
+		bool next_line(const char *&pLine, size_t &lineLength);
+
+	private:
+		PlaylistScanner(const PlaylistScanner &other);
+		PlaylistScanner &operator=(const PlaylistScanner &other);
+
+};
+
+#endif // _PLAYLIST_SCANNER_H
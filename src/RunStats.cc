@@ -0,0 +1,282 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <json/json.h>
+
+#include "Logger.h"
+#include "RunStats.h"
+
+using std::greater;
+using std::map;
+using std::ofstream;
+using std::pair;
+using std::pop_heap;
+using std::push_heap;
+using std::sort_heap;
+using std::string;
+using std::vector;
+
+RunStatsPhase::RunStatsPhase() :
+	m_wallTime(0.0),
+	m_cpuTime(0.0),
+	m_count(0)
+{
+}
+
+RunStatsPhase::RunStatsPhase(const RunStatsPhase &other) :
+	m_wallTime(other.m_wallTime),
+	m_cpuTime(other.m_cpuTime),
+	m_count(other.m_count)
+{
+}
+
+RunStatsPhase::~RunStatsPhase()
+{
+}
+
+RunStatsPhase &RunStatsPhase::operator=(const RunStatsPhase &other)
+{
+	if (this != &other)
+	{
+		m_wallTime = other.m_wallTime;
+		m_cpuTime = other.m_cpuTime;
+		m_count = other.m_count;
+	}
+
+	return *this;
+}
+
+void RunStats::enable(void)
+{
+	// Before any thread is started
+	m_enabled = true;
+	m_startTime = get_wall_time();
+}
+
+bool RunStats::is_enabled(void)
+{
+	return m_enabled;
+}
+
+void RunStats::add_phase(const char *pPhase,
+	double wallTime, double cpuTime)
+{
+	if ((m_enabled == false) ||
+		(pPhase == NULL))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	RunStatsPhase &phase = m_phases[pPhase];
+	phase.m_wallTime += wallTime;
+	phase.m_cpuTime += cpuTime;
+	++phase.m_count;
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void RunStats::add_count(const char *pCounter,
+	unsigned long long value)
+{
+	if ((m_enabled == false) ||
+		(pCounter == NULL))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_counters[pCounter] += value;
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void RunStats::add_file(const string &fileName,
+	double wallTime)
+{
+	if ((m_enabled == false) ||
+		(m_slowestFilesCount == 0))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	// A min-heap of the slowest files so far, the fastest of them on top
+	if (m_slowestFiles.size() < m_slowestFilesCount)
+	{
+		m_slowestFiles.push_back(pair<double, string>(wallTime, fileName));
+		push_heap(m_slowestFiles.begin(), m_slowestFiles.end(), greater<pair<double, string> >());
+	}
+	else if (wallTime > m_slowestFiles.front().first)
+	{
+		pop_heap(m_slowestFiles.begin(), m_slowestFiles.end(), greater<pair<double, string> >());
+		m_slowestFiles.back() = pair<double, string>(wallTime, fileName);
+		push_heap(m_slowestFiles.begin(), m_slowestFiles.end(), greater<pair<double, string> >());
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+bool RunStats::save(const string &fileName,
+	const string &programName)
+{
+	if (m_enabled == false)
+	{
+		return false;
+	}
+
+	Json::Value report(Json::objectValue);
+	Json::Value phases(Json::objectValue);
+	Json::Value counters(Json::objectValue);
+	Json::Value slowestFiles(Json::arrayValue);
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	pthread_mutex_lock(&m_mutex);
+
+	report["program"] = programName;
+	report["wall_time"] = get_wall_time() - m_startTime;
+	report["cpu_time"] = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1000000.0 +
+		(double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1000000.0;
+	report["max_rss_kb"] = (Json::Int64)usage.ru_maxrss;
+
+	for (map<string, RunStatsPhase>::const_iterator phaseIter = m_phases.begin();
+		phaseIter != m_phases.end(); ++phaseIter)
+	{
+		Json::Value phase(Json::objectValue);
+
+		phase["wall_time"] = phaseIter->second.m_wallTime;
+		phase["cpu_time"] = phaseIter->second.m_cpuTime;
+		phase["count"] = (Json::UInt64)phaseIter->second.m_count;
+		phases[phaseIter->first] = phase;
+	}
+	report["phases"] = phases;
+
+	for (map<string, unsigned long long>::const_iterator counterIter = m_counters.begin();
+		counterIter != m_counters.end(); ++counterIter)
+	{
+		counters[counterIter->first] = (Json::UInt64)counterIter->second;
+	}
+	report["counters"] = counters;
+
+	// Slowest first
+	vector<pair<double, string> > files(m_slowestFiles);
+	sort_heap(files.begin(), files.end(), greater<pair<double, string> >());
+	for (vector<pair<double, string> >::const_iterator fileIter = files.begin();
+		fileIter != files.end(); ++fileIter)
+	{
+		Json::Value file(Json::objectValue);
+
+		file["file"] = fileIter->second;
+		file["wall_time"] = fileIter->first;
+		slowestFiles.append(file);
+	}
+	report["slowest_files"] = slowestFiles;
+
+	pthread_mutex_unlock(&m_mutex);
+
+	Json::StyledWriter writer;
+	ofstream reportFile;
+
+	reportFile.open(fileName.c_str());
+	if (reportFile.good() == false)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write to " << fileName;
+		return false;
+	}
+	reportFile << writer.write(report);
+	reportFile.close();
+
+	return true;
+}
+
+double RunStats::get_wall_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+double RunStats::get_cpu_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+unsigned int RunStats::m_slowestFilesCount = 10;
+bool RunStats::m_enabled = false;
+double RunStats::m_startTime = 0.0;
+pthread_mutex_t RunStats::m_mutex = PTHREAD_MUTEX_INITIALIZER;
+map<string, RunStatsPhase> RunStats::m_phases;
+map<string, unsigned long long> RunStats::m_counters;
+vector<pair<double, string> > RunStats::m_slowestFiles;
+
+PhaseTimer::PhaseTimer(const char *pPhase, bool started) :
+	m_pPhase(pPhase),
+	m_running(false),
+	m_startWallTime(0.0),
+	m_startCpuTime(0.0)
+{
+	if (started == true)
+	{
+		start();
+	}
+}
+
+PhaseTimer::~PhaseTimer()
+{
+	stop();
+}
+
+void PhaseTimer::start(void)
+{
+	// Don't even look at the clock when there's no report
+	if (RunStats::is_enabled() == false)
+	{
+		return;
+	}
+
+	m_running = true;
+	m_startWallTime = RunStats::get_wall_time();
+	m_startCpuTime = RunStats::get_cpu_time();
+}
+
+double PhaseTimer::stop(void)
+{
+	if (m_running == false)
+	{
+		return 0.0;
+	}
+
+	double wallTime = RunStats::get_wall_time() - m_startWallTime;
+
+	RunStats::add_phase(m_pPhase, wallTime, RunStats::get_cpu_time() - m_startCpuTime);
+	m_running = false;
+
+	return wallTime;
+}
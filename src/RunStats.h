@@ -0,0 +1,109 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _RUN_STATS_H
+#define _RUN_STATS_H
+
+#include <pthread.h>
+#include <string>
+#include <map>
+#include <utility>
+#include <vector>
+
+class RunStatsPhase
+{
+	public:
+		RunStatsPhase();
+		RunStatsPhase(const RunStatsPhase &other);
+		virtual ~RunStatsPhase();
+
+		RunStatsPhase &operator=(const RunStatsPhase &other);
+
+		double m_wallTime;
+		double m_cpuTime;
+		unsigned long long m_count;
+
+};
+
+// Time spent in each phase of a run and counters, saved as a JSON report with --stats.
+// Methods may be called from any thread, and do nothing unless the report was enabled
+class RunStats
+{
+	public:
+		static void enable(void);
+
+		static bool is_enabled(void);
+
+		static void add_phase(const char *pPhase,
+			double wallTime, double cpuTime);
+
+		static void add_count(const char *pCounter,
+			unsigned long long value = 1);
+
+		static void add_file(const std::string &fileName,
+			double wallTime);
+
+		static bool save(const std::string &fileName,
+			const std::string &programName);
+
+		static double get_wall_time(void);
+
+		static double get_cpu_time(void);
+
+		static unsigned int m_slowestFilesCount;
+
+	protected:
+		static bool m_enabled;
+		static double m_startTime;
+		static pthread_mutex_t m_mutex;
+		static std::map<std::string, RunStatsPhase> m_phases;
+		static std::map<std::string, unsigned long long> m_counters;
+		static std::vector<std::pair<double, std::string> > m_slowestFiles;
+
+	private:
+		RunStats();
+		RunStats(const RunStats &other);
+		RunStats &operator=(const RunStats &other);
+
+};
+
+// Adds the time between start() and stop() to a phase, stopping on destruction if need be.
+// Time on the CPU is that of the calling thread
+class PhaseTimer
+{
+	public:
+		PhaseTimer(const char *pPhase, bool started = true);
+		~PhaseTimer();
+
+		void start(void);
+
+		double stop(void);
+
+	protected:
+		const char *m_pPhase;
+		bool m_running;
+		double m_startWallTime;
+		double m_startCpuTime;
+
+	private:
+		PhaseTimer(const PhaseTimer &other);
+		PhaseTimer &operator=(const PhaseTimer &other);
+
+};
+
+#endif // _RUN_STATS_H
@@ -0,0 +1,281 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "Logger.h"
+#include "TagCache.h"
+#include "Utilities.h"
+
+using std::getline;
+using std::ifstream;
+using std::map;
+using std::ofstream;
+using std::pair;
+using std::string;
+using std::vector;
+
+static const char *g_cacheHeader = "# mppl tag cache 2";
+
+TagCacheEntry::TagCacheEntry() :
+	m_size(0),
+	m_modTime(0),
+	m_tagged(false),
+	m_problem(PROBLEM_NONE),
+	m_number(0),
+	m_year(0),
+	m_used(false)
+{
+}
+
+TagCacheEntry::TagCacheEntry(const TagCacheEntry &other) :
+	m_size(other.m_size),
+	m_modTime(other.m_modTime),
+	m_tagged(other.m_tagged),
+	m_problem(other.m_problem),
+	m_title(other.m_title),
+	m_artist(other.m_artist),
+	m_album(other.m_album),
+	m_number(other.m_number),
+	m_year(other.m_year),
+	m_used(other.m_used)
+{
+}
+
+TagCacheEntry::~TagCacheEntry()
+{
+}
+
+TagCacheEntry &TagCacheEntry::operator=(const TagCacheEntry &other)
+{
+	if (this != &other)
+	{
+		m_size = other.m_size;
+		m_modTime = other.m_modTime;
+		m_tagged = other.m_tagged;
+		m_problem = other.m_problem;
+		m_title = other.m_title;
+		m_artist = other.m_artist;
+		m_album = other.m_album;
+		m_number = other.m_number;
+		m_year = other.m_year;
+		m_used = other.m_used;
+	}
+
+	return *this;
+}
+
+TagCache::TagCache(const string &fileName) :
+	m_fileName(fileName),
+	m_hitsCount(0),
+	m_missesCount(0)
+{
+}
+
+TagCache::~TagCache()
+{
+}
+
+bool TagCache::load(void)
+{
+	ifstream inputFile;
+	string line;
+
+	inputFile.open(m_fileName.c_str());
+	if (inputFile.good() == false)
+	{
+		LogMessage(LOG_LEVEL_INFO) << "No tag cache at " << m_fileName;
+		return false;
+	}
+
+	// Ignore caches written in another format
+	if ((getline(inputFile, line).fail() == true) ||
+		(line != g_cacheHeader))
+	{
+		LogMessage(LOG_LEVEL_WARNING) << "Ignoring tag cache " << m_fileName;
+		return false;
+	}
+
+	while (getline(inputFile, line).fail() == false)
+	{
+		vector<string> fields;
+
+		split_line(line, fields);
+		if (fields.size() != 10)
+		{
+			continue;
+		}
+
+		TagCacheEntry entry;
+
+		entry.m_size = (off_t)strtoll(fields[1].c_str(), NULL, 10);
+		entry.m_modTime = (time_t)strtoll(fields[2].c_str(), NULL, 10);
+		entry.m_tagged = (fields[3] == "1");
+		entry.m_problem = (LogProblem)atoi(fields[4].c_str());
+		entry.m_number = atoi(fields[5].c_str());
+		entry.m_year = atoi(fields[6].c_str());
+		entry.m_title = unescape_field(fields[7]);
+		entry.m_artist = unescape_field(fields[8]);
+		entry.m_album = unescape_field(fields[9]);
+		if ((entry.m_problem < PROBLEM_NONE) ||
+			(entry.m_problem >= PROBLEM_COUNT))
+		{
+			continue;
+		}
+
+		m_entries[unescape_field(fields[0])] = entry;
+	}
+
+	LogMessage(LOG_LEVEL_INFO) << "Loaded " << m_entries.size() << " entries from tag cache " << m_fileName;
+
+	return true;
+}
+
+bool TagCache::save(void)
+{
+	string tmpFileName(m_fileName + ".tmp");
+	ofstream outputFile;
+
+	LogMessage(LOG_LEVEL_INFO) << "Tag cache had " << m_hitsCount << " hit(s), " << m_missesCount << " miss(es)";
+
+	outputFile.open(tmpFileName.c_str());
+	if (outputFile.good() == false)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write to " << tmpFileName;
+		return false;
+	}
+
+	outputFile << g_cacheHeader << "\n";
+
+	// Files that weren't found during this run are dropped
+	for (map<string, TagCacheEntry>::const_iterator entryIter = m_entries.begin();
+		entryIter != m_entries.end(); ++entryIter)
+	{
+		const TagCacheEntry &entry = entryIter->second;
+
+		if (entry.m_used == false)
+		{
+			continue;
+		}
+
+		outputFile << escape_field(entryIter->first) << '\t'
+			<< (long long)entry.m_size << '\t'
+			<< (long long)entry.m_modTime << '\t'
+			<< (entry.m_tagged == true ? "1" : "0") << '\t'
+			<< (int)entry.m_problem << '\t'
+			<< entry.m_number << '\t'
+			<< entry.m_year << '\t'
+			<< escape_field(entry.m_title) << '\t'
+			<< escape_field(entry.m_artist) << '\t'
+			<< escape_field(entry.m_album) << "\n";
+	}
+
+	outputFile.close();
+	if (outputFile.fail() == true)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write to " << tmpFileName;
+		return false;
+	}
+
+	// Don't leave a truncated cache behind
+	if (rename(tmpFileName.c_str(), m_fileName.c_str()) != 0)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to rename " << tmpFileName << " to " << m_fileName;
+		return false;
+	}
+
+	return true;
+}
+
+bool TagCache::has_tags(const string &entryName,
+	off_t size, time_t modTime) const
+{
+	map<string, TagCacheEntry>::const_iterator entryIter = m_entries.find(entryName);
+
+	if ((entryIter == m_entries.end()) ||
+		(entryIter->second.m_size != size) ||
+		(entryIter->second.m_modTime != modTime))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool TagCache::get_tags(const string &entryName,
+	off_t size, time_t modTime,
+	Track &track, bool &tagged,
+	LogProblem &problem)
+{
+	map<string, TagCacheEntry>::iterator entryIter = m_entries.find(entryName);
+
+	if ((entryIter == m_entries.end()) ||
+		(entryIter->second.m_size != size) ||
+		(entryIter->second.m_modTime != modTime))
+	{
+		++m_missesCount;
+		return false;
+	}
+
+	TagCacheEntry &entry = entryIter->second;
+
+	entry.m_used = true;
+	tagged = entry.m_tagged;
+	problem = entry.m_problem;
+	if (tagged == true)
+	{
+		track.set_tags(entry.m_title, entry.m_artist, entry.m_album,
+			entry.m_number, entry.m_year);
+	}
+	++m_hitsCount;
+
+	return true;
+}
+
+void TagCache::set_tags(const string &entryName,
+	off_t size, time_t modTime,
+	const Track &track, bool tagged,
+	LogProblem problem)
+{
+	TagCacheEntry &entry = m_entries[entryName];
+
+	entry.m_size = size;
+	entry.m_modTime = modTime;
+	entry.m_tagged = tagged;
+	entry.m_problem = problem;
+	entry.m_used = true;
+	if (tagged == true)
+	{
+		entry.m_title = track.get_title();
+		entry.m_artist = track.get_artist();
+		entry.m_album = track.get_album();
+		entry.m_number = track.get_number();
+		entry.m_year = track.get_year();
+	}
+	else
+	{
+		entry.m_title.clear();
+		entry.m_artist.clear();
+		entry.m_album.clear();
+		entry.m_number = entry.m_year = 0;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TAG_CACHE_H
+#define _TAG_CACHE_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <string>
+#include <map>
+
+#include "Logger.h"
+#include "Track.h"
+
+class TagCacheEntry
+{
+	public:
+		TagCacheEntry();
+		TagCacheEntry(const TagCacheEntry &other);
+		virtual ~TagCacheEntry();
+
+		TagCacheEntry &operator=(const TagCacheEntry &other);
+
+		off_t m_size;
+		time_t m_modTime;
+		bool m_tagged;
+		LogProblem m_problem;
+		std::string m_title;
+		std::string m_artist;
+		std::string m_album;
+		int m_number;
+		int m_year;
+		bool m_used;
+
+};
+
+// Tags of files found by previous runs, keyed by path and checked against size and mtime
+class TagCache
+{
+	public:
+		TagCache(const std::string &fileName);
+		virtual ~TagCache();
+
+		bool load(void);
+
+		bool save(void);
+
+		bool has_tags(const std::string &entryName,
+			off_t size, time_t modTime) const;
+
+		bool get_tags(const std::string &entryName,
+			off_t size, time_t modTime,
+			Track &track, bool &tagged,
+			LogProblem &problem);
+
+		void set_tags(const std::string &entryName,
+			off_t size, time_t modTime,
+			const Track &track, bool tagged,
+			LogProblem problem);
+
+	protected:
+		std::string m_fileName;
+		std::map<std::string, TagCacheEntry> m_entries;
+		unsigned int m_hitsCount;
+		unsigned int m_missesCount;
+
+	private:
+		TagCache(const TagCache &other);
+		TagCache &operator=(const TagCache &other);
+
+};
+
+#endif // _TAG_CACHE_H
@@ -0,0 +1,1247 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include "RunStats.h"
+#include "TagScanner.h"
+#include "Utilities.h"
+
+using std::string;
+
+static unsigned int read_be32(const string &data, size_t pos)
+{
+	return ((unsigned int)(unsigned char)data[pos] << 24) |
+		((unsigned int)(unsigned char)data[pos + 1] << 16) |
+		((unsigned int)(unsigned char)data[pos + 2] << 8) |
+		(unsigned int)(unsigned char)data[pos + 3];
+}
+
+static unsigned int read_le32(const string &data, size_t pos)
+{
+	return ((unsigned int)(unsigned char)data[pos + 3] << 24) |
+		((unsigned int)(unsigned char)data[pos + 2] << 16) |
+		((unsigned int)(unsigned char)data[pos + 1] << 8) |
+		(unsigned int)(unsigned char)data[pos];
+}
+
+static bool read_syncsafe(const string &data, size_t pos, unsigned int &value)
+{
+	value = 0;
+
+	for (size_t bytePos = pos; bytePos < pos + 4; ++bytePos)
+	{
+		unsigned char byte = (unsigned char)data[bytePos];
+
+		// Buggy taggers write plain integers here
+		if ((byte & 0x80) != 0)
+		{
+			return false;
+		}
+
+		value = (value << 7) | byte;
+	}
+
+	return true;
+}
+
+static bool is_valid_utf8(const char *pData, size_t length)
+{
+	const unsigned char *pChar = (const unsigned char *)pData;
+	const unsigned char *pEnd = pChar + length;
+
+	while (pChar < pEnd)
+	{
+		unsigned int codePoint = *pChar;
+		size_t continuationCount = 0;
+
+		if (codePoint == 0)
+		{
+			return false;
+		}
+		else if (codePoint < 0x80)
+		{
+			++pChar;
+			continue;
+		}
+		else if ((codePoint & 0xE0) == 0xC0)
+		{
+			codePoint &= 0x1F;
+			continuationCount = 1;
+		}
+		else if ((codePoint & 0xF0) == 0xE0)
+		{
+			codePoint &= 0x0F;
+			continuationCount = 2;
+		}
+		else if ((codePoint & 0xF8) == 0xF0)
+		{
+			codePoint &= 0x07;
+			continuationCount = 3;
+		}
+		else
+		{
+			return false;
+		}
+
+		if ((size_t)(pEnd - pChar) <= continuationCount)
+		{
+			return false;
+		}
+
+		for (size_t bytePos = 1; bytePos <= continuationCount; ++bytePos)
+		{
+			if ((pChar[bytePos] & 0xC0) != 0x80)
+			{
+				return false;
+			}
+			codePoint = (codePoint << 6) | (pChar[bytePos] & 0x3F);
+		}
+
+		// Overlong encodings, surrogates and out of range code points
+		if (((continuationCount == 1) && (codePoint < 0x80)) ||
+			((continuationCount == 2) && (codePoint < 0x800)) ||
+			((continuationCount == 3) && (codePoint < 0x10000)) ||
+			((codePoint >= 0xD800) && (codePoint <= 0xDFFF)) ||
+			(codePoint > 0x10FFFF))
+		{
+			return false;
+		}
+
+		pChar += continuationCount + 1;
+	}
+
+	return true;
+}
+
+static void latin1_to_utf8(const char *pData, size_t length,
+	string &value)
+{
+	value.clear();
+	for (size_t charPos = 0; charPos < length; ++charPos)
+	{
+		append_utf8((unsigned char)pData[charPos], value);
+	}
+}
+
+static bool utf16_to_utf8(const char *pData, size_t length,
+	bool bigEndian, string &value)
+{
+	value.clear();
+
+	if (length % 2 != 0)
+	{
+		return false;
+	}
+
+	for (size_t charPos = 0; charPos < length; charPos += 2)
+	{
+		unsigned int firstByte = (unsigned char)pData[charPos];
+		unsigned int secondByte = (unsigned char)pData[charPos + 1];
+		unsigned int codePoint = (bigEndian == true ? (firstByte << 8) | secondByte : (secondByte << 8) | firstByte);
+
+		if ((codePoint >= 0xD800) &&
+			(codePoint <= 0xDBFF))
+		{
+			if (charPos + 4 > length)
+			{
+				return false;
+			}
+
+			firstByte = (unsigned char)pData[charPos + 2];
+			secondByte = (unsigned char)pData[charPos + 3];
+			unsigned int lowSurrogate = (bigEndian == true ? (firstByte << 8) | secondByte : (secondByte << 8) | firstByte);
+
+			if ((lowSurrogate < 0xDC00) ||
+				(lowSurrogate > 0xDFFF))
+			{
+				return false;
+			}
+
+			codePoint = 0x10000 + ((codePoint & 0x3FF) << 10) + (lowSurrogate & 0x3FF);
+			charPos += 2;
+		}
+		else if ((codePoint >= 0xDC00) &&
+			(codePoint <= 0xDFFF))
+		{
+			return false;
+		}
+
+		append_utf8(codePoint, value);
+	}
+
+	return true;
+}
+
+// Decodes a text information frame, giving up on lists of values
+static bool decode_id3v2_text(const string &data, string &value)
+{
+	value.clear();
+
+	if (data.empty() == true)
+	{
+		return true;
+	}
+
+	unsigned char encoding = (unsigned char)data[0];
+	size_t charSize = ((encoding == 1) || (encoding == 2) ? 2 : 1);
+	size_t startPos = 1, endPos = 1;
+	bool foundValue = false;
+
+	if (encoding > 3)
+	{
+		return false;
+	}
+
+	// Split on terminators, ignoring empty strings like TagLib does
+	while (startPos < data.length())
+	{
+		endPos = startPos;
+		while ((endPos + charSize <= data.length()) &&
+			((data[endPos] != '\0') ||
+			((charSize == 2) && (data[endPos + 1] != '\0'))))
+		{
+			endPos += charSize;
+		}
+		if (endPos + charSize > data.length())
+		{
+			endPos = data.length();
+		}
+
+		if (endPos > startPos)
+		{
+			const char *pString = data.data() + startPos;
+			size_t stringLength = endPos - startPos;
+
+			if (foundValue == true)
+			{
+				return false;
+			}
+			foundValue = true;
+
+			if (encoding == 0)
+			{
+				latin1_to_utf8(pString, stringLength, value);
+			}
+			else if (encoding == 3)
+			{
+				if (is_valid_utf8(pString, stringLength) == false)
+				{
+					return false;
+				}
+				value.assign(pString, stringLength);
+			}
+			else if (encoding == 2)
+			{
+				if (utf16_to_utf8(pString, stringLength, true, value) == false)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				// There must be a byte order mark
+				if ((stringLength < 2) ||
+					((memcmp(pString, "\xFF\xFE", 2) != 0) &&
+					(memcmp(pString, "\xFE\xFF", 2) != 0)))
+				{
+					return false;
+				}
+
+				if (utf16_to_utf8(pString + 2, stringLength - 2, (pString[0] == '\xFE'), value) == false)
+				{
+					return false;
+				}
+			}
+		}
+
+		startPos = endPos + charSize;
+	}
+
+	return true;
+}
+
+// Parses numbers the way TagLib does, giving up on anything but leading digits
+static bool parse_number(const string &str, size_t maxLength, int &value)
+{
+	size_t length = ((maxLength > 0) && (str.length() > maxLength) ? maxLength : str.length());
+
+	value = 0;
+
+	if (length == 0)
+	{
+		return true;
+	}
+	else if ((str[0] < '0') ||
+		(str[0] > '9'))
+	{
+		return false;
+	}
+
+	for (size_t charPos = 0; (charPos < length) && (str[charPos] >= '0') && (str[charPos] <= '9'); ++charPos)
+	{
+		if (charPos >= 9)
+		{
+			return false;
+		}
+
+		value = (value * 10) + (str[charPos] - '0');
+	}
+
+	return true;
+}
+
+static void strip_white_space(string &str)
+{
+	string::size_type startPos = str.find_first_not_of(" \t\n\r\f");
+
+	if (startPos == string::npos)
+	{
+		str.clear();
+		return;
+	}
+
+	str.erase(str.find_last_not_of(" \t\n\r\f") + 1);
+	str.erase(0, startPos);
+}
+
+TagScanner::TagScanner(const string &fileName) :
+	m_isAudio(true),
+	m_number(0),
+	m_year(0),
+	m_fileName(fileName),
+	m_fd(-1),
+	m_fileLength(0),
+	m_bytesRead(0)
+{
+	for (unsigned int fieldNum = 0; fieldNum < FIELD_COUNT; ++fieldNum)
+	{
+		m_hasField[fieldNum] = false;
+	}
+}
+
+TagScanner::~TagScanner()
+{
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+
+	RunStats::add_count("bytes_read", m_bytesRead);
+}
+
+bool TagScanner::scan(void)
+{
+	string::size_type pos = m_fileName.find_last_of('.');
+	struct stat fileStat;
+
+	if (pos == string::npos)
+	{
+		return false;
+	}
+
+	string extension(to_lower_case(m_fileName.substr(pos)));
+
+	if ((extension != ".mp3") &&
+		(extension != ".flac") &&
+		(extension != ".ogg") &&
+		(extension != ".opus") &&
+		(extension != ".m4a") &&
+		(extension != ".m4b") &&
+		(extension != ".mp4"))
+	{
+		return false;
+	}
+
+	m_fd = open(m_fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if ((m_fd < 0) ||
+		(fstat(m_fd, &fileStat) != 0) ||
+		(S_ISREG(fileStat.st_mode) == 0))
+	{
+		return false;
+	}
+	m_fileLength = fileStat.st_size;
+
+	// Most of what's needed is in the first few KB
+	size_t headerLength = ((off_t)m_headerSize < m_fileLength ? m_headerSize : (size_t)m_fileLength);
+
+	m_header.resize(headerLength);
+	if ((headerLength == 0) ||
+		(pread(m_fd, &m_header[0], headerLength, 0) != (ssize_t)headerLength))
+	{
+		return false;
+	}
+	m_bytesRead += headerLength;
+
+	// Files named like audio files may well be something else
+	if (is_audio_header(m_header.data(), m_header.length()) == false)
+	{
+		m_isAudio = false;
+		return false;
+	}
+
+	bool scanned = false;
+
+	if (extension == ".mp3")
+	{
+		scanned = scan_mpeg();
+	}
+	else if (extension == ".flac")
+	{
+		scanned = scan_flac();
+	}
+	else if (extension == ".ogg")
+	{
+		scanned = scan_ogg(false);
+	}
+	else if (extension == ".opus")
+	{
+		scanned = scan_ogg(true);
+	}
+	else
+	{
+		scanned = scan_mp4();
+	}
+
+	// Leave it to TagLib to complain about empty tags
+	if ((scanned == false) ||
+		((m_title.empty() == true) &&
+		(m_artist.empty() == true) &&
+		(m_album.empty() == true) &&
+		(m_number == 0) &&
+		(m_year == 0)))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool TagScanner::is_audio_header(const char *pHeader, size_t headerLength)
+{
+	// Signatures of files commonly found alongside audio files
+	const char *pSignatures[] = { "\xFF\xD8\xFF", "\x89PNG", "GIF8", "%PDF", "PK\x03\x04",
+		"<!DOCTYPE", "<!doctype", "<html", "<HTML", "<?xml", "\x7F" "ELF", NULL };
+
+	for (unsigned int signatureNum = 0; pSignatures[signatureNum] != NULL; ++signatureNum)
+	{
+		size_t signatureLength = strlen(pSignatures[signatureNum]);
+
+		if ((headerLength >= signatureLength) &&
+			(memcmp(pHeader, pSignatures[signatureNum], signatureLength) == 0))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool TagScanner::read_at(off_t offset, size_t length,
+	string &data)
+{
+	if ((offset < 0) ||
+		(offset + (off_t)length > m_fileLength))
+	{
+		return false;
+	}
+
+	if (offset + (off_t)length <= (off_t)m_header.length())
+	{
+		data.assign(m_header, (size_t)offset, length);
+		return true;
+	}
+	else if (length > m_maxBlockSize)
+	{
+		return false;
+	}
+
+	data.resize(length);
+
+	size_t readLength = 0;
+	while (readLength < length)
+	{
+		ssize_t bytesRead = pread(m_fd, &data[readLength], length - readLength, offset + (off_t)readLength);
+
+		if ((bytesRead < 0) &&
+			(errno == EINTR))
+		{
+			continue;
+		}
+		else if (bytesRead <= 0)
+		{
+			return false;
+		}
+
+		readLength += (size_t)bytesRead;
+	}
+	m_bytesRead += readLength;
+
+	return true;
+}
+
+bool TagScanner::set_field(TagField field, const string &value)
+{
+	// Repeated fields aren't handled consistently across TagLib versions
+	if (m_hasField[field] == true)
+	{
+		return false;
+	}
+
+	m_fields[field] = value;
+	m_hasField[field] = true;
+
+	return true;
+}
+
+bool TagScanner::has_all_fields(void) const
+{
+	if ((m_title.empty() == true) ||
+		(m_artist.empty() == true) ||
+		(m_album.empty() == true) ||
+		(m_number == 0) ||
+		(m_year == 0))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool TagScanner::find_trailing_tags(bool &hasID3v1, string &id3v1Tag)
+{
+	off_t tailLength = (m_fileLength < 160 ? m_fileLength : 160);
+	string tail;
+
+	hasID3v1 = false;
+
+	if (read_at(m_fileLength - tailLength, (size_t)tailLength, tail) == false)
+	{
+		return false;
+	}
+
+	if ((tail.length() >= 128) &&
+		(tail.compare(tail.length() - 128, 3, "TAG") == 0))
+	{
+		hasID3v1 = true;
+		id3v1Tag = tail.substr(tail.length() - 128);
+	}
+
+	// APE tags aren't handled here
+	size_t footerLength = (hasID3v1 == true ? 128 : 0) + 32;
+	if ((tail.length() >= footerLength) &&
+		(tail.compare(tail.length() - footerLength, 8, "APETAGEX") == 0))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool TagScanner::scan_mpeg(void)
+{
+	off_t tagLength = 0;
+	bool hasID3v1 = false;
+	string id3v1Tag;
+
+	if ((scan_id3v2(tagLength) == false) ||
+		(find_trailing_tags(hasID3v1, id3v1Tag) == false) ||
+		(get_fields(4) == false))
+	{
+		return false;
+	}
+
+	// Like TagLib, fill in blanks from the ID3v1 tag
+	if ((hasID3v1 == true) &&
+		(has_all_fields() == false))
+	{
+		return scan_id3v1(id3v1Tag);
+	}
+
+	return true;
+}
+
+bool TagScanner::scan_id3v2(off_t &tagLength)
+{
+	unsigned int tagSize = 0;
+
+	if ((m_header.length() < 10) ||
+		(m_header.compare(0, 3, "ID3") != 0))
+	{
+		return false;
+	}
+
+	unsigned char majorVersion = (unsigned char)m_header[3];
+	unsigned char flags = (unsigned char)m_header[5];
+
+	// Unsynchronisation and extended headers
+	if (((majorVersion != 3) && (majorVersion != 4)) ||
+		((flags & 0xC0) != 0) ||
+		(read_syncsafe(m_header, 6, tagSize) == false))
+	{
+		return false;
+	}
+
+	tagLength = 10 + (off_t)tagSize + ((flags & 0x10) != 0 ? 10 : 0);
+	if (tagLength > m_fileLength)
+	{
+		return false;
+	}
+
+	off_t framePos = 10;
+	off_t framesEnd = 10 + (off_t)tagSize;
+	string frameHeader, frameData, value;
+
+	while (framePos + 10 <= framesEnd)
+	{
+		unsigned int frameSize = 0;
+
+		if (read_at(framePos, 10, frameHeader) == false)
+		{
+			return false;
+		}
+
+		// Padding
+		if (frameHeader[0] == '\0')
+		{
+			break;
+		}
+
+		for (unsigned int charPos = 0; charPos < 4; ++charPos)
+		{
+			char idChar = frameHeader[charPos];
+
+			if (((idChar < 'A') || (idChar > 'Z')) &&
+				((idChar < '0') || (idChar > '9')))
+			{
+				return false;
+			}
+		}
+
+		unsigned char formatFlags = (unsigned char)frameHeader[9];
+
+		if (majorVersion == 4)
+		{
+			// Grouping, compression, encryption, unsynchronisation, data length
+			if ((read_syncsafe(frameHeader, 4, frameSize) == false) ||
+				((formatFlags & 0x4F) != 0))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			frameSize = read_be32(frameHeader, 4);
+
+			// Compression, encryption, grouping
+			if ((formatFlags & 0xE0) != 0)
+			{
+				return false;
+			}
+		}
+
+		if ((frameSize == 0) ||
+			(framePos + 10 + (off_t)frameSize > framesEnd))
+		{
+			return false;
+		}
+
+		string frameId(frameHeader, 0, 4);
+		TagField field = FIELD_COUNT;
+
+		if (frameId == "TIT2")
+		{
+			field = FIELD_TITLE;
+		}
+		else if (frameId == "TPE1")
+		{
+			field = FIELD_ARTIST;
+		}
+		else if (frameId == "TALB")
+		{
+			field = FIELD_ALBUM;
+		}
+		else if (frameId == "TRCK")
+		{
+			field = FIELD_NUMBER;
+		}
+		else if ((frameId == "TDRC") ||
+			(frameId == "TYER"))
+		{
+			field = FIELD_YEAR;
+		}
+		else if (frameId == "TPE2")
+		{
+			field = FIELD_ALBUM_ARTIST;
+		}
+
+		if (field != FIELD_COUNT)
+		{
+			if ((read_at(framePos + 10, frameSize, frameData) == false) ||
+				(decode_id3v2_text(frameData, value) == false) ||
+				(set_field(field, value) == false))
+			{
+				return false;
+			}
+		}
+
+		framePos += 10 + (off_t)frameSize;
+	}
+
+	return true;
+}
+
+bool TagScanner::scan_id3v1(const string &id3v1Tag)
+{
+	string value;
+	int number = 0;
+
+	if (m_title.empty() == true)
+	{
+		latin1_to_utf8(id3v1Tag.data() + 3, strnlen(id3v1Tag.data() + 3, 30), m_title);
+		strip_white_space(m_title);
+	}
+	if (m_artist.empty() == true)
+	{
+		latin1_to_utf8(id3v1Tag.data() + 33, strnlen(id3v1Tag.data() + 33, 30), m_artist);
+		strip_white_space(m_artist);
+	}
+	if (m_album.empty() == true)
+	{
+		latin1_to_utf8(id3v1Tag.data() + 63, strnlen(id3v1Tag.data() + 63, 30), m_album);
+		strip_white_space(m_album);
+	}
+	if (m_year == 0)
+	{
+		value.assign(id3v1Tag.data() + 93, strnlen(id3v1Tag.data() + 93, 4));
+		if (parse_number(value, 0, number) == false)
+		{
+			return false;
+		}
+		m_year = number;
+	}
+	if ((m_number == 0) &&
+		(id3v1Tag[125] == '\0'))
+	{
+		// ID3v1.1
+		m_number = (unsigned char)id3v1Tag[126];
+	}
+
+	return true;
+}
+
+bool TagScanner::scan_flac(void)
+{
+	bool hasID3v1 = false, foundComment = false;
+	string id3v1Tag, blockHeader, block;
+	off_t blockPos = 4;
+
+	if ((m_header.length() < 8) ||
+		(m_header.compare(0, 4, "fLaC") != 0) ||
+		((m_header[4] & 0x7F) != 0))
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		if (read_at(blockPos, 4, blockHeader) == false)
+		{
+			return false;
+		}
+
+		bool isLast = ((blockHeader[0] & 0x80) != 0);
+		unsigned char blockType = (unsigned char)(blockHeader[0] & 0x7F);
+		off_t blockLength = (off_t)(read_be32(blockHeader, 0) & 0xFFFFFF);
+
+		// Only padding may be empty
+		if ((blockType == 127) ||
+			((blockLength == 0) && (blockType != 1)) ||
+			(blockPos + 4 + blockLength > m_fileLength))
+		{
+			return false;
+		}
+
+		if (blockType == 4)
+		{
+			if ((foundComment == true) ||
+				(read_at(blockPos + 4, (size_t)blockLength, block) == false) ||
+				(scan_xiph_comment(block, 0) == false))
+			{
+				return false;
+			}
+			foundComment = true;
+		}
+
+		blockPos += 4 + blockLength;
+		if (isLast == true)
+		{
+			break;
+		}
+	}
+
+	if ((foundComment == false) ||
+		(find_trailing_tags(hasID3v1, id3v1Tag) == false) ||
+		(get_fields(0) == false))
+	{
+		return false;
+	}
+
+	// Leave blanks that an ID3v1 tag may fill to TagLib
+	if ((hasID3v1 == true) &&
+		(has_all_fields() == false))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool TagScanner::scan_ogg(bool opus)
+{
+	string pageHeader, segmentTable, pageData, packet;
+	off_t pagePos = 0;
+	unsigned int serialNumber = 0, packetNum = 0;
+	bool inPacket = false;
+
+	// Only the identification and comment packets are needed
+	while (packetNum < 2)
+	{
+		if ((read_at(pagePos, 27, pageHeader) == false) ||
+			(pageHeader.compare(0, 4, "OggS") != 0) ||
+			(pageHeader[4] != '\0'))
+		{
+			return false;
+		}
+
+		unsigned char headerType = (unsigned char)pageHeader[5];
+		unsigned int segmentsCount = (unsigned char)pageHeader[26];
+
+		// A single logical stream is expected
+		if (pagePos == 0)
+		{
+			if ((headerType & 0x02) == 0)
+			{
+				return false;
+			}
+			serialNumber = read_le32(pageHeader, 14);
+		}
+		else if (((headerType & 0x02) != 0) ||
+			(read_le32(pageHeader, 14) != serialNumber))
+		{
+			return false;
+		}
+
+		if (((headerType & 0x01) != 0) != inPacket)
+		{
+			return false;
+		}
+
+		if (read_at(pagePos + 27, segmentsCount, segmentTable) == false)
+		{
+			return false;
+		}
+
+		size_t dataLength = 0;
+		for (unsigned int segmentNum = 0; segmentNum < segmentsCount; ++segmentNum)
+		{
+			dataLength += (unsigned char)segmentTable[segmentNum];
+		}
+
+		off_t dataPos = pagePos + 27 + (off_t)segmentsCount;
+		if (read_at(dataPos, dataLength, pageData) == false)
+		{
+			return false;
+		}
+
+		size_t segmentPos = 0;
+		for (unsigned int segmentNum = 0; (segmentNum < segmentsCount) && (packetNum < 2); ++segmentNum)
+		{
+			size_t segmentLength = (unsigned char)segmentTable[segmentNum];
+
+			packet.append(pageData, segmentPos, segmentLength);
+			segmentPos += segmentLength;
+
+			if (packet.length() > m_maxBlockSize)
+			{
+				return false;
+			}
+
+			inPacket = true;
+			if (segmentLength < 255)
+			{
+				if (packetNum == 0)
+				{
+					if ((opus == true) &&
+						(packet.compare(0, 8, "OpusHead") != 0))
+					{
+						return false;
+					}
+					else if ((opus == false) &&
+						(packet.compare(0, 7, "\x01vorbis") != 0))
+					{
+						return false;
+					}
+				}
+				else if (opus == true)
+				{
+					if ((packet.compare(0, 8, "OpusTags") != 0) ||
+						(scan_xiph_comment(packet, 8) == false))
+					{
+						return false;
+					}
+				}
+				else if ((packet.compare(0, 7, "\x03vorbis") != 0) ||
+					(scan_xiph_comment(packet, 7) == false))
+				{
+					return false;
+				}
+
+				++packetNum;
+				packet.clear();
+				inPacket = false;
+			}
+		}
+
+		pagePos = dataPos + (off_t)dataLength;
+	}
+
+	return get_fields(0);
+}
+
+bool TagScanner::scan_xiph_comment(const string &data,
+	size_t offset)
+{
+	string trackNum, year;
+	bool hasTrackNum = false, hasYear = false;
+	size_t pos = offset;
+
+	if (pos + 4 > data.length())
+	{
+		return false;
+	}
+
+	// Skip the vendor string
+	pos += 4 + read_le32(data, pos);
+	if (pos + 4 > data.length())
+	{
+		return false;
+	}
+
+	unsigned int fieldsCount = read_le32(data, pos);
+	pos += 4;
+
+	for (unsigned int fieldNum = 0; fieldNum < fieldsCount; ++fieldNum)
+	{
+		if (pos + 4 > data.length())
+		{
+			return false;
+		}
+
+		size_t fieldLength = read_le32(data, pos);
+		pos += 4;
+		if (fieldLength > data.length() - pos)
+		{
+			return false;
+		}
+
+		string::size_type equalPos = data.find('=', pos);
+
+		if ((equalPos == string::npos) ||
+			(equalPos >= pos + fieldLength))
+		{
+			// TagLib skips these
+			pos += fieldLength;
+			continue;
+		}
+
+		string key(to_lower_case(data.substr(pos, equalPos - pos)));
+		const char *pValue = data.data() + equalPos + 1;
+		size_t valueLength = pos + fieldLength - equalPos - 1;
+		TagField field = FIELD_COUNT;
+
+		pos += fieldLength;
+
+		if (key == "title")
+		{
+			field = FIELD_TITLE;
+		}
+		else if (key == "artist")
+		{
+			field = FIELD_ARTIST;
+		}
+		else if (key == "album")
+		{
+			field = FIELD_ALBUM;
+		}
+		else if (key == "tracknumber")
+		{
+			field = FIELD_NUMBER;
+		}
+		else if (key == "date")
+		{
+			field = FIELD_YEAR;
+		}
+		else if ((key != "tracknum") &&
+			(key != "year"))
+		{
+			continue;
+		}
+
+		if (is_valid_utf8(pValue, valueLength) == false)
+		{
+			return false;
+		}
+
+		if (field != FIELD_COUNT)
+		{
+			if (set_field(field, string(pValue, valueLength)) == false)
+			{
+				return false;
+			}
+		}
+		else if (key == "tracknum")
+		{
+			if (hasTrackNum == true)
+			{
+				return false;
+			}
+			trackNum.assign(pValue, valueLength);
+			hasTrackNum = true;
+		}
+		else
+		{
+			if (hasYear == true)
+			{
+				return false;
+			}
+			year.assign(pValue, valueLength);
+			hasYear = true;
+		}
+	}
+
+	// These are only looked at when the usual fields are missing
+	if ((m_hasField[FIELD_NUMBER] == false) &&
+		(hasTrackNum == true))
+	{
+		set_field(FIELD_NUMBER, trackNum);
+	}
+	if ((m_hasField[FIELD_YEAR] == false) &&
+		(hasYear == true))
+	{
+		set_field(FIELD_YEAR, year);
+	}
+
+	return true;
+}
+
+bool TagScanner::scan_mp4(void)
+{
+	off_t atomPos = 0, atomsEnd = m_fileLength;
+	bool found = false;
+	const char *pPath[] = { "moov", "udta", "meta", "ilst" };
+
+	for (unsigned int pathNum = 0; pathNum < 4; ++pathNum)
+	{
+		if ((find_mp4_atom(atomPos, atomsEnd, pPath[pathNum], found) == false) ||
+			(found == false))
+		{
+			return false;
+		}
+
+		// meta is a full atom
+		if (pathNum == 2)
+		{
+			string versionFlags;
+
+			if ((read_at(atomPos, 4, versionFlags) == false) ||
+				(read_be32(versionFlags, 0) != 0))
+			{
+				return false;
+			}
+			atomPos += 4;
+		}
+	}
+
+	string itemHeader, item;
+
+	// Go through items in the list
+	while (atomPos < atomsEnd)
+	{
+		if ((atomsEnd - atomPos < 8) ||
+			(read_at(atomPos, 8, itemHeader) == false))
+		{
+			return false;
+		}
+
+		off_t itemLength = (off_t)read_be32(itemHeader, 0);
+		string itemName(itemHeader, 4, 4);
+		TagField field = FIELD_COUNT;
+
+		if ((itemLength < 8) ||
+			(atomPos + itemLength > atomsEnd))
+		{
+			return false;
+		}
+
+		if (itemName == "\xA9nam")
+		{
+			field = FIELD_TITLE;
+		}
+		else if (itemName == "\xA9" "ART")
+		{
+			field = FIELD_ARTIST;
+		}
+		else if (itemName == "\xA9" "alb")
+		{
+			field = FIELD_ALBUM;
+		}
+		else if (itemName == "trkn")
+		{
+			field = FIELD_NUMBER;
+		}
+		else if (itemName == "\xA9" "day")
+		{
+			field = FIELD_YEAR;
+		}
+
+		if (field != FIELD_COUNT)
+		{
+			// A single data atom is expected
+			if ((read_at(atomPos + 8, (size_t)(itemLength - 8), item) == false) ||
+				(item.length() < 16) ||
+				(read_be32(item, 0) != item.length()) ||
+				(item.compare(4, 4, "data") != 0))
+			{
+				return false;
+			}
+
+			unsigned int dataType = read_be32(item, 8);
+
+			if (field == FIELD_NUMBER)
+			{
+				char numberStr[16];
+
+				if ((item.length() < 22) ||
+					((item[18] & 0x80) != 0))
+				{
+					return false;
+				}
+
+				snprintf(numberStr, 16, "%u", ((unsigned int)(unsigned char)item[18] << 8) | (unsigned char)item[19]);
+				if (set_field(field, numberStr) == false)
+				{
+					return false;
+				}
+			}
+			else if ((dataType != 1) ||
+				(is_valid_utf8(item.data() + 16, item.length() - 16) == false) ||
+				(set_field(field, item.substr(16)) == false))
+			{
+				return false;
+			}
+		}
+
+		atomPos += itemLength;
+	}
+
+	return get_fields(0);
+}
+
+bool TagScanner::find_mp4_atom(off_t &offset, off_t &endOffset,
+	const char *pName, bool &found)
+{
+	string atomHeader;
+
+	found = false;
+
+	while (offset < endOffset)
+	{
+		off_t headerLength = 8;
+
+		if ((endOffset - offset < 8) ||
+			(read_at(offset, 8, atomHeader) == false))
+		{
+			return false;
+		}
+
+		off_t atomLength = (off_t)read_be32(atomHeader, 0);
+
+		if (atomLength == 1)
+		{
+			string largeSize;
+
+			// 64-bit length
+			if (read_at(offset + 8, 8, largeSize) == false)
+			{
+				return false;
+			}
+			atomLength = (off_t)(((unsigned long long)read_be32(largeSize, 0) << 32) | read_be32(largeSize, 4));
+			headerLength = 16;
+		}
+		else if (atomLength == 0)
+		{
+			// Runs to the end
+			atomLength = endOffset - offset;
+		}
+
+		if ((atomLength < headerLength) ||
+			(atomLength > endOffset - offset))
+		{
+			return false;
+		}
+
+		if (atomHeader.compare(4, 4, pName) == 0)
+		{
+			found = true;
+			endOffset = offset + atomLength;
+			offset += headerLength;
+
+			return true;
+		}
+
+		offset += atomLength;
+	}
+
+	return true;
+}
+
+bool TagScanner::get_fields(size_t yearLength)
+{
+	m_title = m_fields[FIELD_TITLE];
+	m_artist = m_fields[FIELD_ARTIST];
+	m_album = m_fields[FIELD_ALBUM];
+	m_albumArtist = m_fields[FIELD_ALBUM_ARTIST];
+
+	if ((parse_number(m_fields[FIELD_NUMBER], 0, m_number) == false) ||
+		(parse_number(m_fields[FIELD_YEAR], yearLength, m_year) == false))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+size_t TagScanner::m_headerSize = 8192;
+size_t TagScanner::m_maxBlockSize = 65536;
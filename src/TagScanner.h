@@ -0,0 +1,94 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TAG_SCANNER_H
+#define _TAG_SCANNER_H
+
+#include <sys/types.h>
+#include <string>
+
+// Reads the few tags needed out of MP3, FLAC, Ogg and MP4 files without going through TagLib.
+// Anything unusual makes scan() fail, in which case TagLib should be used instead
+class TagScanner
+{
+	public:
+		TagScanner(const std::string &fileName);
+		virtual ~TagScanner();
+
+		bool scan(void);
+
+		static bool is_audio_header(const char *pHeader, size_t headerLength);
+
+		bool m_isAudio;
+		std::string m_title;
+		std::string m_artist;
+		std::string m_album;
+		std::string m_albumArtist;
+		int m_number;
+		int m_year;
+
+		static size_t m_headerSize;
+		static size_t m_maxBlockSize;
+
+	protected:
+		typedef enum { FIELD_TITLE = 0, FIELD_ARTIST, FIELD_ALBUM, FIELD_NUMBER, FIELD_YEAR, FIELD_ALBUM_ARTIST, FIELD_COUNT } TagField;
+
+		std::string m_fileName;
+		int m_fd;
+		off_t m_fileLength;
+		size_t m_bytesRead;
+		std::string m_header;
+		std::string m_fields[FIELD_COUNT];
+		bool m_hasField[FIELD_COUNT];
+
+		bool read_at(off_t offset, size_t length,
+			std::string &data);
+
+		bool set_field(TagField field, const std::string &value);
+
+		bool has_all_fields(void) const;
+
+		bool find_trailing_tags(bool &hasID3v1, std::string &id3v1Tag);
+
+		bool scan_mpeg(void);
+
+		bool scan_id3v2(off_t &tagLength);
+
+		bool scan_id3v1(const std::string &id3v1Tag);
+
+		bool scan_flac(void);
+
+		bool scan_ogg(bool opus);
+
+		bool scan_mp4(void);
+
+		bool find_mp4_atom(off_t &offset, off_t &endOffset,
+			const char *pName, bool &found);
+
+		bool scan_xiph_comment(const std::string &data,
+			size_t offset);
+
+		bool get_fields(size_t yearLength);
+
+	private:
+		TagScanner(const TagScanner &other);
+		TagScanner &operator=(const TagScanner &other);
+
+};
+
+#endif // _TAG_SCANNER_H
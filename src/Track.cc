@@ -16,32 +16,61 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <fileref.h>
 #include <id3v2tag.h>
 #include <mpegfile.h>
 #include <tfile.h>
+#ifdef HAVE_LIBURING
+#include <id3v2framefactory.h>
+#include <tiostream.h>
+#endif
 #include <utf8proc.h>
 #include <algorithm>
 #include <iostream>
-#include <fstream>
 
+#include "Logger.h"
+#include "RunStats.h"
+#include "TagScanner.h"
 #include "Track.h"
 #include "Utilities.h"
 
-using std::clog;
-using std::endl;
 using std::max;
 using std::min;
-using std::ofstream;
+using std::move;
+using std::set;
 using std::string;
 using std::vector;
 
+// Extensions of the formats TagLib knows about
+static set<string> get_default_extensions(void)
+{
+	const char *pExtensions[] = { "3g2", "aif", "aifc", "aiff", "ape", "asf", "dff", "dsf",
+		"flac", "it", "m4a", "m4b", "m4p", "m4r", "m4v", "mod", "mp3", "mp4", "mpc",
+		"oga", "ogg", "opus", "s3m", "spx", "tta", "wav", "wma", "wv", "xm", NULL };
+	set<string> extensions;
+
+	for (unsigned int extNum = 0; pExtensions[extNum] != NULL; ++extNum)
+	{
+		extensions.insert(pExtensions[extNum]);
+	}
+
+	return extensions;
+}
+
 Track::Track(const string &trackPath,
 	time_t modTime) :
 	m_trackPath(trackPath),
+	m_pArtist(StringPool::get_empty()),
+	m_pArtistKey(StringPool::get_empty()),
+	m_pAlbum(StringPool::get_empty()),
+	m_pAlbumArt(StringPool::get_empty()),
 	m_number(0),
 	m_year(2023),
 	m_modTime(modTime),
@@ -52,9 +81,10 @@ Track::Track(const string &trackPath,
 Track::Track(const Track &other) :
 	m_trackPath(other.m_trackPath),
 	m_title(other.m_title),
-	m_artist(other.m_artist),
-	m_album(other.m_album),
-	m_albumArt(other.m_albumArt),
+	m_pArtist(other.m_pArtist),
+	m_pArtistKey(other.m_pArtistKey),
+	m_pAlbum(other.m_pAlbum),
+	m_pAlbumArt(other.m_pAlbumArt),
 	m_uri(other.m_uri),
 	m_number(other.m_number),
 	m_year(other.m_year),
@@ -63,6 +93,21 @@ Track::Track(const Track &other) :
 {
 }
 
+Track::Track(Track &&other) noexcept :
+	m_trackPath(move(other.m_trackPath)),
+	m_title(move(other.m_title)),
+	m_pArtist(other.m_pArtist),
+	m_pArtistKey(other.m_pArtistKey),
+	m_pAlbum(other.m_pAlbum),
+	m_pAlbumArt(other.m_pAlbumArt),
+	m_uri(move(other.m_uri)),
+	m_number(other.m_number),
+	m_year(other.m_year),
+	m_modTime(other.m_modTime),
+	m_sort(other.m_sort)
+{
+}
+
 Track::~Track()
 {
 }
@@ -73,9 +118,10 @@ Track &Track::operator=(const Track &other)
 	{
 		m_trackPath = other.m_trackPath;
 		m_title = other.m_title;
-		m_artist = other.m_artist;
-		m_album = other.m_album;
-		m_albumArt = other.m_albumArt;
+		m_pArtist = other.m_pArtist;
+		m_pArtistKey = other.m_pArtistKey;
+		m_pAlbum = other.m_pAlbum;
+		m_pAlbumArt = other.m_pAlbumArt;
 		m_uri = other.m_uri;
 		m_number = other.m_number;
 		m_year = other.m_year;
@@ -86,6 +132,26 @@ Track &Track::operator=(const Track &other)
 	return *this;
 }
 
+Track &Track::operator=(Track &&other) noexcept
+{
+	if (this != &other)
+	{
+		m_trackPath = move(other.m_trackPath);
+		m_title = move(other.m_title);
+		m_pArtist = other.m_pArtist;
+		m_pArtistKey = other.m_pArtistKey;
+		m_pAlbum = other.m_pAlbum;
+		m_pAlbumArt = other.m_pAlbumArt;
+		m_uri = move(other.m_uri);
+		m_number = other.m_number;
+		m_year = other.m_year;
+		m_modTime = other.m_modTime;
+		m_sort = other.m_sort;
+	}
+
+	return *this;
+}
+
 void Track::adjust_path(void)
 {
 	// FIXME: detect and handle Windows paths
@@ -103,12 +169,17 @@ void Track::adjust_path(void)
 
 bool Track::operator<(const Track &other) const
 {
-	if (m_sort == TRACK_SORT_MTIME)
+	return is_before(other, m_sort);
+}
+
+bool Track::is_before(const Track &other, TrackSort sort) const
+{
+	if (sort == TRACK_SORT_MTIME)
 	{
 		return sort_by_mtime(other);
 	}
 
-	return sort_by_artist(other);
+	return sort_by_artist(other, sort);
 }
 
 string Track::normalized_track_name(void) const
@@ -128,22 +199,35 @@ string Track::normalized_track_name(void) const
 	return normalizedName;
 }
 
-bool Track::read_tags(TagLib::Tag *pTag)
+bool Track::read_tags(TagLib::Tag *pTag,
+	LogBuffer &logBuffer)
 {
 	if ((pTag == NULL) ||
 		(pTag->isEmpty() == true))
 	{
-		clog << "Failed to find tags in " << m_trackPath << endl;
+		logBuffer.problem(PROBLEM_NO_TAGS, m_trackPath);
 		return false;
 	}
 
-	m_title = pTag->title().toCString(true);
-	m_artist = pTag->artist().toCString(true);
-	m_album = pTag->album().toCString(true);
-	m_albumArt.clear();
+	set_tags(pTag->title().toCString(true),
+		pTag->artist().toCString(true),
+		pTag->album().toCString(true),
+		(int)pTag->track(), (int)pTag->year());
+
+	return true;
+}
+
+void Track::set_tags(const string &title,
+	const string &artist, const string &album,
+	int number, int year)
+{
+	m_title = title;
+	set_artist(artist);
+	m_pAlbum = StringPool::intern(album);
+	m_pAlbumArt = StringPool::get_empty();
 	m_uri = m_musicLibrary;
-	m_number = pTag->track();
-	m_year = pTag->year();
+	m_number = number;
+	m_year = year;
 
 	if (m_toPath.empty() == false)
 	{
@@ -170,73 +254,101 @@ bool Track::read_tags(TagLib::Tag *pTag)
 		m_uri += "/";
 	}
 	m_uri += m_trackPath;
-
-	return true;
 }
 
-bool Track::retrieve_tags_any(void)
+bool Track::retrieve_tags_any(LogBuffer &logBuffer,
+	TagLib::IOStream *pStream)
 {
+#ifdef HAVE_LIBURING
+	TagLib::FileRef fileRef = (pStream != NULL ? TagLib::FileRef(pStream, false) :
+		TagLib::FileRef(m_trackPath.c_str(), false));
+#else
 	TagLib::FileRef fileRef(m_trackPath.c_str(), false);
+#endif
 
 	if (fileRef.isNull() == true)
 	{
-		clog << "Failed to load " << m_trackPath << endl;
+		logBuffer.problem(PROBLEM_LOAD_FAILED, m_trackPath);
 		return false;
 	}
 
 	TagLib::Tag *pTag = fileRef.tag();
 
-	return read_tags(pTag);
+	return read_tags(pTag, logBuffer);
 }
 
-bool Track::retrieve_tags_mp3(void)
+bool Track::retrieve_tags_mp3(LogBuffer &logBuffer,
+	TagLib::IOStream *pStream)
 {
+#ifdef HAVE_LIBURING
+	if (pStream != NULL)
+	{
+#if TAGLIB_MAJOR_VERSION >= 2
+		TagLib::MPEG::File mpegFile(pStream, false);
+#else
+		TagLib::MPEG::File mpegFile(pStream, TagLib::ID3v2::FrameFactory::instance(), false);
+#endif
+
+		return read_mpeg_tags(mpegFile, logBuffer);
+	}
+#endif
 	TagLib::MPEG::File mpegFile(m_trackPath.c_str(), false);
 
+	return read_mpeg_tags(mpegFile, logBuffer);
+}
+
+bool Track::read_mpeg_tags(TagLib::MPEG::File &mpegFile,
+	LogBuffer &logBuffer)
+{
 	if (mpegFile.isValid() == false)
 	{
-		clog << "Failed to load " << m_trackPath << endl;
+		logBuffer.problem(PROBLEM_LOAD_FAILED, m_trackPath);
 		return false;
 	}
 
 	TagLib::Tag *pTag = mpegFile.tag();
 
-	if (read_tags(pTag) == false)
+	if (read_tags(pTag, logBuffer) == false)
 	{
 		return false;
 	}
 
-	if ((m_artist.empty() == true) &&
+	if ((m_pArtist->empty() == true) &&
 		mpegFile.hasID3v2Tag())
 	{
 		TagLib::ID3v2::Tag *pV2Tag = mpegFile.ID3v2Tag();
 		TagLib::ID3v2::FrameList tagList = pV2Tag->frameListMap()["TPE2"];
+		string artist;
 
 		// Look for the artist in TPE2
 		for (TagLib::ID3v2::FrameList::ConstIterator frameIter = tagList.begin();
 			frameIter != tagList.end(); ++frameIter)
 		{
-			m_artist = (*frameIter)->toString().toCString(true);
-			if (m_artist.empty() == false)
+			artist = (*frameIter)->toString().toCString(true);
+			if (artist.empty() == false)
 			{
 				break;
 			}
 		}
+
+		set_artist(artist);
 	}
 
 	return true;
 }
 
-bool Track::retrieve_tags(void)
+bool Track::retrieve_tags(LogBuffer &logBuffer,
+	TagLib::IOStream *pStream)
 {
-	// Does the file exist?
-	if (access(m_trackPath.c_str(), F_OK) == -1)
+	// Does the file exist? A stream implies it was opened already
+	if ((pStream == NULL) &&
+		(access(m_trackPath.c_str(), F_OK) == -1))
 	{
 		string trackPath(normalized_track_name());
 
 		if (access(trackPath.c_str(), F_OK) == -1)
 		{
-			clog << "Failed to open " << m_trackPath << endl;
+			logBuffer.problem(PROBLEM_OPEN_FAILED, m_trackPath);
 			return false;
 		}
 
@@ -245,14 +357,64 @@ bool Track::retrieve_tags(void)
 	}
 
 	string::size_type pos = m_trackPath.find(".mp3");
+	bool isMP3 = ((pos != string::npos) && (pos == m_trackPath.length() - 4));
+
+#ifdef HAVE_LIBURING
+	if (pStream != NULL)
+	{
+		// The first bytes were read already
+		TagLib::ByteVector header(pStream->readBlock(16));
+
+		pStream->seek(0);
+		if (TagScanner::is_audio_header(header.data(), header.size()) == false)
+		{
+			logBuffer.problem(PROBLEM_NOT_AUDIO, m_trackPath);
+			return false;
+		}
+	}
+#endif
+
+	// Try reading the header directly before going through TagLib
+	if ((m_scanTags == true) &&
+		(pStream == NULL))
+	{
+		TagScanner scanner(m_trackPath);
+
+		if (scanner.scan() == true)
+		{
+			set_tags(scanner.m_title, scanner.m_artist, scanner.m_album,
+				scanner.m_number, scanner.m_year);
+
+			// Look for the artist in TPE2
+			if ((isMP3 == true) &&
+				(m_pArtist->empty() == true))
+			{
+				set_artist(scanner.m_albumArtist);
+			}
+
+			return true;
+		}
+		else if (scanner.m_isAudio == false)
+		{
+			// Don't let TagLib open it again
+			logBuffer.problem(PROBLEM_NOT_AUDIO, m_trackPath);
+			return false;
+		}
+	}
 
-	if ((pos != string::npos) &&
-		(pos == m_trackPath.length() - 4))
+	if (isMP3 == true)
 	{
-		return retrieve_tags_mp3();
+		return retrieve_tags_mp3(logBuffer, pStream);
 	}
 
-	return retrieve_tags_any();
+	return retrieve_tags_any(logBuffer, pStream);
+}
+
+void Track::set_artist(const string &artist)
+{
+	m_pArtist = StringPool::intern(artist);
+	// Lower case once here rather than on every comparison
+	m_pArtistKey = StringPool::intern(fold_case(artist));
 }
 
 const string &Track::get_title(void) const
@@ -262,17 +424,22 @@ const string &Track::get_title(void) const
 
 const string &Track::get_artist(void) const
 {
-	return m_artist;
+	return *m_pArtist;
 }
 
 const string &Track::get_album(void) const
 {
-	return m_album;
+	return *m_pAlbum;
+}
+
+int Track::get_number(void) const
+{
+	return m_number;
 }
 
 void Track::set_album_art(const string &albumArt)
 {
-	m_albumArt = albumArt;
+	m_pAlbumArt = StringPool::intern(albumArt);
 }
 
 int Track::get_year(void) const
@@ -294,33 +461,34 @@ Json::Value Track::to_json(void) const
 {
 	Json::Value object;
 
-	object["album"] = m_album;
-	object["artist"] = m_artist;
+	object["album"] = *m_pAlbum;
+	object["artist"] = *m_pArtist;
 	object["service"] = "mpd";
 	object["title"] = m_title;
 	object["type"] = "song";
 	object["uri"] = m_uri;
 	object["year"] = m_year;
 
-	if (m_albumArt.empty() == false)
+	if (m_pAlbumArt->empty() == false)
 	{
-		object["albumart"] = m_albumArt;
+		object["albumart"] = *m_pAlbumArt;
 	}
 
 	return object;
 }
 
-bool Track::sort_by_artist(const Track &other) const
+bool Track::sort_by_artist(const Track &other, TrackSort sort) const
 {
-	string artist(to_lower_case(m_artist)), otherArtist(to_lower_case(other.m_artist));
+	// Interned strings that are equal are the same string
+	int artistOrder = (m_pArtistKey == other.m_pArtistKey ? 0 : m_pArtistKey->compare(*other.m_pArtistKey));
 
-	if (artist < otherArtist)
+	if (artistOrder < 0)
 	{
 		return true;
 	}
-	else if (artist == otherArtist)
+	else if (artistOrder == 0)
 	{
-		if (m_sort == TRACK_SORT_YEAR)
+		if (sort == TRACK_SORT_YEAR)
 		{
 			return sort_by_year(other);
 		}
@@ -335,17 +503,17 @@ bool Track::sort_by_artist(const Track &other) const
 
 bool Track::sort_by_album(const Track &other) const
 {
-	if (m_album < other.m_album)
-	{
-		return true;
-	}
-	else if (m_album == other.m_album)
+	if (m_pAlbum == other.m_pAlbum)
 	{
 		if (m_number < other.m_number)
 		{
 			return true;
 		}
 	}
+	else if (*m_pAlbum < *other.m_pAlbum)
+	{
+		return true;
+	}
 
 	return false;
 }
@@ -366,10 +534,8 @@ bool Track::sort_by_year(const Track &other) const
 
 bool Track::sort_by_mtime(const Track &other) const
 {
-	string artist(to_lower_case(m_artist)), otherArtist(to_lower_case(other.m_artist));
-
 	// Tracks from the same artist within 10 minutes are sorted by year
-	if (artist == otherArtist)
+	if (m_pArtistKey == other.m_pArtistKey)
 	{
 		double seconds = difftime(max(m_modTime, other.m_modTime),
 			min(m_modTime, other.m_modTime));
@@ -386,45 +552,452 @@ bool Track::sort_by_mtime(const Track &other) const
 	}
 	else if (m_modTime == other.m_modTime)
 	{
-		return sort_by_artist(other);
+		return sort_by_artist(other, TRACK_SORT_MTIME);
 	}
 
 	return false;
 }
 
+void Track::append_json(string &output) const
+{
+	char yearStr[16];
+
+	// Keys are in the order Json::FastWriter sorts them in
+	output += "{\"album\":";
+	append_json_string(*m_pAlbum, output);
+	if (m_pAlbumArt->empty() == false)
+	{
+		output += ",\"albumart\":";
+		append_json_string(*m_pAlbumArt, output);
+	}
+	output += ",\"artist\":";
+	append_json_string(*m_pArtist, output);
+	output += ",\"service\":\"mpd\",\"title\":";
+	append_json_string(m_title, output);
+	output += ",\"type\":\"song\",\"uri\":";
+	append_json_string(m_uri, output);
+	snprintf(yearStr, sizeof(yearStr), "%d", m_year);
+	output += ",\"year\":";
+	output += yearStr;
+	output += "}";
+}
+
+uint64_t Track::get_digest(TrackSort sort) const
+{
+	char numbersStr[64];
+
+	// Cover what's written out and what playlists are sorted on
+	uint64_t digest = hash_string(m_uri);
+	digest = hash_string(m_title, digest);
+	digest = hash_string(*m_pArtist, digest);
+	digest = hash_string(*m_pAlbum, digest);
+	digest = hash_string(*m_pAlbumArt, digest);
+	snprintf(numbersStr, sizeof(numbersStr), "%d %d %ld", m_number, m_year,
+		(sort == TRACK_SORT_MTIME ? (long)m_modTime : 0L));
+
+	return hash_string(numbersStr, digest);
+}
+
+static bool write_buffer(int fd, const char *pData, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t bytesWritten = write(fd, pData, length);
+
+		if (bytesWritten < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		pData += bytesWritten;
+		length -= (size_t)bytesWritten;
+		RunStats::add_count("bytes_written", (unsigned long long)bytesWritten);
+	}
+
+	return true;
+}
+
+static ssize_t read_buffer(int fd, char *pData, size_t length)
+{
+	size_t totalBytes = 0;
+
+	while (totalBytes < length)
+	{
+		ssize_t bytesRead = read(fd, pData + totalBytes, length - totalBytes);
+
+		if (bytesRead < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return -1;
+		}
+		else if (bytesRead == 0)
+		{
+			break;
+		}
+
+		totalBytes += (size_t)bytesRead;
+	}
+	RunStats::add_count("bytes_read", totalBytes);
+
+	return (ssize_t)totalBytes;
+}
+
+// Compares content with the existing file as it comes in, and only replaces it if they differ
+class PlaylistFile
+{
+	public:
+		PlaylistFile(const string &fileName) :
+			m_fileName(fileName),
+			m_tmpFileName(fileName + ".tmp"),
+			m_existingFd(open(fileName.c_str(), O_RDONLY | O_CLOEXEC)),
+			m_fd(-1),
+			m_matchedLength(0)
+		{
+		}
+		~PlaylistFile()
+		{
+			if (m_existingFd >= 0)
+			{
+				close(m_existingFd);
+			}
+			if (m_fd >= 0)
+			{
+				// Don't leave a truncated file behind
+				close(m_fd);
+				unlink(m_tmpFileName.c_str());
+			}
+		}
+
+		bool write_data(const char *pData, size_t length)
+		{
+			if ((m_fd < 0) &&
+				(m_existingFd >= 0))
+			{
+				m_existingData.resize(length);
+
+				ssize_t bytesRead = read_buffer(m_existingFd, &m_existingData[0], length);
+
+				if ((bytesRead == (ssize_t)length) &&
+					(memcmp(&m_existingData[0], pData, length) == 0))
+				{
+					m_matchedLength += bytesRead;
+					return true;
+				}
+			}
+
+			if ((m_fd < 0) &&
+				(start_writing() == false))
+			{
+				return false;
+			}
+
+			return write_buffer(m_fd, pData, length);
+		}
+
+		bool close_file(bool &changed)
+		{
+			char extraByte;
+
+			changed = true;
+
+			if (m_fd < 0)
+			{
+				// Is the existing file any longer?
+				if ((m_existingFd >= 0) &&
+					(read_buffer(m_existingFd, &extraByte, 1) == 0))
+				{
+					changed = false;
+					return true;
+				}
+
+				if (start_writing() == false)
+				{
+					return false;
+				}
+			}
+
+			int fd = m_fd;
+
+			m_fd = -1;
+			if (close(fd) != 0)
+			{
+				unlink(m_tmpFileName.c_str());
+				return false;
+			}
+
+			if (rename(m_tmpFileName.c_str(), m_fileName.c_str()) != 0)
+			{
+				unlink(m_tmpFileName.c_str());
+				return false;
+			}
+
+			return true;
+		}
+
+	protected:
+		string m_fileName;
+		string m_tmpFileName;
+		int m_existingFd;
+		int m_fd;
+		off_t m_matchedLength;
+		vector<char> m_existingData;
+
+		bool start_writing(void)
+		{
+			m_fd = open(m_tmpFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+			if (m_fd < 0)
+			{
+				return false;
+			}
+
+			// The new file replaces the existing one, permissions included
+			struct stat existingStat;
+			if ((m_existingFd >= 0) &&
+				(fstat(m_existingFd, &existingStat) == 0))
+			{
+				fchmod(m_fd, existingStat.st_mode & 07777);
+			}
+
+			// What was already compared is the same, copy it over
+			if (m_matchedLength > 0)
+			{
+				vector<char> data(65536);
+				off_t offset = 0;
+
+				while (offset < m_matchedLength)
+				{
+					size_t length = (size_t)min((off_t)data.size(), m_matchedLength - offset);
+					ssize_t bytesRead = pread(m_existingFd, &data[0], length, offset);
+
+					if ((bytesRead <= 0) ||
+						(write_buffer(m_fd, &data[0], (size_t)bytesRead) == false))
+					{
+						return false;
+					}
+
+					offset += bytesRead;
+				}
+			}
+
+			if (m_existingFd >= 0)
+			{
+				close(m_existingFd);
+				m_existingFd = -1;
+			}
+
+			return true;
+		}
+
+};
+
+static void close_playlist_file(PlaylistFile &outputFile,
+	const string &outputFileName, bool writeFailed)
+{
+	bool changed = true;
+
+	if ((writeFailed == true) ||
+		(outputFile.close_file(changed) == false))
+	{
+		Logger::log(LOG_LEVEL_ERROR, "Failed to write to " + outputFileName);
+		RunStats::add_count("playlists_failed");
+	}
+	else if (changed == false)
+	{
+		++Track::m_unchangedFilesCount;
+		RunStats::add_count("playlists_unchanged");
+	}
+	else
+	{
+		++Track::m_writtenFilesCount;
+		RunStats::add_count("playlists_written");
+	}
+}
+
+void Track::render_playlist(const vector<Track> &tracks,
+	string &output)
+{
+	render_tracks(tracks, NULL, output);
+}
+
+void Track::render_playlist(const vector<Track> &tracks,
+	const vector<unsigned int> &trackIndices,
+	string &output)
+{
+	render_tracks(tracks, &trackIndices, output);
+}
+
 void Track::write_file(const string &outputFileName,
 	const vector<Track> &tracks)
 {
-	ofstream outputFile;
+	write_tracks(outputFileName, tracks, NULL);
+}
+
+void Track::write_file(const string &outputFileName,
+	const vector<Track> &tracks,
+	const vector<unsigned int> &trackIndices)
+{
+	write_tracks(outputFileName, tracks, &trackIndices);
+}
+
+void Track::write_file(const string &outputFileName,
+	const string &content)
+{
+	PhaseTimer writeTimer("write");
+	PlaylistFile outputFile(outputFileName);
+	bool writeFailed = false;
+
+	if (Logger::is_enabled(LOG_LEVEL_DEBUG) == true)
+	{
+		Logger::log(LOG_LEVEL_DEBUG, "Writing " + outputFileName);
+	}
 
-	clog << "Writing " << outputFileName << endl;
+	// The content was rendered already, likely on a worker thread
+	for (string::size_type pos = 0; pos < content.length(); pos += m_writeBufferSize)
+	{
+		if (outputFile.write_data(content.data() + pos,
+			min(content.length() - pos, m_writeBufferSize)) == false)
+		{
+			writeFailed = true;
+			break;
+		}
+	}
+
+	close_playlist_file(outputFile, outputFileName, writeFailed);
+}
+
+void Track::set_audio_extensions(const string &extensions)
+{
+	string::size_type startPos = 0;
 
-	outputFile.open(outputFileName.c_str());
+	m_audioExtensions.clear();
 
-	// Dump the JSON content
-	if (outputFile.good() == true)
+	// A comma separated list, leading dots are optional
+	while (startPos <= extensions.length())
 	{
-		Json::FastWriter writer;
-		Json::Value allTracks(Json::arrayValue);
-		unsigned int trackIndex = 0;
+		string::size_type endPos = extensions.find(',', startPos);
 
-		for (vector<Track>::const_iterator trackIter = tracks.begin();
-			trackIter != tracks.end(); ++trackIter)
+		if (endPos == string::npos)
 		{
-			allTracks[trackIndex] = trackIter->to_json();
-			++trackIndex;
+			endPos = extensions.length();
 		}
 
-		outputFile << writer.write(allTracks);
+		string extension(extensions.substr(startPos, endPos - startPos));
 
-		outputFile.close();
+		if ((extension.empty() == false) &&
+			(extension[0] == '.'))
+		{
+			extension.erase(0, 1);
+		}
+		if (extension.empty() == false)
+		{
+			m_audioExtensions.insert(to_lower_case(extension));
+		}
+
+		startPos = endPos + 1;
 	}
-	else
+}
+
+bool Track::is_audio_file(const string &fileName)
+{
+	string::size_type dotPos = fileName.find_last_of('.');
+	string::size_type slashPos = fileName.find_last_of('/');
+
+	if ((dotPos == string::npos) ||
+		((slashPos != string::npos) && (dotPos < slashPos)))
+	{
+		return false;
+	}
+
+	// Compare extensions in lower case
+	if (m_audioExtensions.find(to_lower_case(fileName.substr(dotPos + 1))) == m_audioExtensions.end())
+	{
+		return false;
+	}
+
+	return true;
+}
+
+void Track::render_tracks(const vector<Track> &tracks,
+	const vector<unsigned int> *pTrackIndices,
+	string &output)
+{
+	// Without indices, all tracks are listed in order
+	size_t tracksCount = (pTrackIndices == NULL ? tracks.size() : pTrackIndices->size());
+
+	output += "[";
+	for (size_t trackNum = 0; trackNum < tracksCount; ++trackNum)
+	{
+		if (trackNum > 0)
+		{
+			output += ",";
+		}
+		tracks[pTrackIndices == NULL ? trackNum : (*pTrackIndices)[trackNum]].append_json(output);
+	}
+	output += "]\n";
+}
+
+void Track::write_tracks(const string &outputFileName,
+	const vector<Track> &tracks,
+	const vector<unsigned int> *pTrackIndices)
+{
+	PhaseTimer writeTimer("write");
+	PlaylistFile outputFile(outputFileName);
+	size_t tracksCount = (pTrackIndices == NULL ? tracks.size() : pTrackIndices->size());
+
+	if (Logger::is_enabled(LOG_LEVEL_DEBUG) == true)
+	{
+		Logger::log(LOG_LEVEL_DEBUG, "Writing " + outputFileName);
+	}
+
+	// Stream the JSON content, one track at a time
+	string buffer("[");
+	bool writeFailed = false;
+
+	buffer.reserve(m_writeBufferSize + 1024);
+
+	for (size_t trackNum = 0; trackNum < tracksCount; ++trackNum)
+	{
+		if (trackNum > 0)
+		{
+			buffer += ",";
+		}
+		tracks[pTrackIndices == NULL ? trackNum : (*pTrackIndices)[trackNum]].append_json(buffer);
+
+		if (buffer.length() >= m_writeBufferSize)
+		{
+			if (outputFile.write_data(buffer.data(), buffer.length()) == false)
+			{
+				writeFailed = true;
+				break;
+			}
+			buffer.clear();
+		}
+	}
+	buffer += "]\n";
+
+	if ((writeFailed == false) &&
+		(outputFile.write_data(buffer.data(), buffer.length()) == false))
 	{
-		clog << "Failed to write to " << outputFileName << endl;
+		writeFailed = true;
 	}
+
+	close_playlist_file(outputFile, outputFileName, writeFailed);
 }
 
+size_t Track::m_writeBufferSize = 65536;
+bool Track::m_scanTags = true;
+set<string> Track::m_audioExtensions(get_default_extensions());
+unsigned int Track::m_writtenFilesCount = 0;
+unsigned int Track::m_unchangedFilesCount = 0;
 string Track::m_musicLibrary;
 string Track::m_fromPath;
 string Track::m_toPath;
@@ -20,27 +20,52 @@
 #define _TRACK_H
 
 #include <tag.h>
+#include <stdint.h>
 #include <time.h>
+#include <iostream>
+#include <set>
 #include <string>
+#include <vector>
 #include <json/json.h>
 
+#include "Logger.h"
+
+namespace TagLib
+{
+	class IOStream;
+	namespace MPEG
+	{
+		class File;
+	}
+}
+
 typedef enum { TRACK_SORT_ALPHA = 0, TRACK_SORT_YEAR, TRACK_SORT_MTIME } TrackSort;
 
+// Tracks are held by value in large stores, they aren't meant to be derived from
 class Track
 {
 	public:
 		Track(const std::string &trackPath,
 			time_t modTime = 0);
 		Track(const Track &other);
-		virtual ~Track();
+		Track(Track &&other) noexcept;
+		~Track();
 
 		Track &operator=(const Track &other);
+		Track &operator=(Track &&other) noexcept;
 
 		void adjust_path(void);
 
 		bool operator<(const Track &other) const;
 
-		bool retrieve_tags(void);
+		bool is_before(const Track &other, TrackSort sort) const;
+
+		bool retrieve_tags(LogBuffer &logBuffer,
+			TagLib::IOStream *pStream = NULL);
+
+		void set_tags(const std::string &title,
+			const std::string &artist, const std::string &album,
+			int number, int year);
 
 		const std::string &get_title(void) const;
 
@@ -48,6 +73,8 @@ class Track
 
 		const std::string &get_album(void) const;
 
+		int get_number(void) const;
+
 		void set_album_art(const std::string &albumArt);
 
 		int get_year(void) const;
@@ -58,19 +85,48 @@ class Track
 
 		Json::Value to_json(void) const;
 
+		void append_json(std::string &output) const;
+
+		uint64_t get_digest(TrackSort sort) const;
+
+		static void render_playlist(const std::vector<Track> &tracks,
+			std::string &output);
+
+		static void render_playlist(const std::vector<Track> &tracks,
+			const std::vector<unsigned int> &trackIndices,
+			std::string &output);
+
 		static void write_file(const std::string &outputFileName,
 			const std::vector<Track> &tracks);
 
+		static void write_file(const std::string &outputFileName,
+			const std::vector<Track> &tracks,
+			const std::vector<unsigned int> &trackIndices);
+
+		static void write_file(const std::string &outputFileName,
+			const std::string &content);
+
+		static void set_audio_extensions(const std::string &extensions);
+
+		static bool is_audio_file(const std::string &fileName);
+
 		static std::string m_musicLibrary;
 		static std::string m_fromPath;
 		static std::string m_toPath;
+		static size_t m_writeBufferSize;
+		static bool m_scanTags;
+		static std::set<std::string> m_audioExtensions;
+		static unsigned int m_writtenFilesCount;
+		static unsigned int m_unchangedFilesCount;
 
 	protected:
 		std::string m_trackPath;
 		std::string m_title;
-		std::string m_artist;
-		std::string m_album;
-		std::string m_albumArt;
+		// These repeat across tracks, they are interned
+		const std::string *m_pArtist;
+		const std::string *m_pArtistKey;
+		const std::string *m_pAlbum;
+		const std::string *m_pAlbumArt;
 		std::string m_uri;
 		int m_number;
 		int m_year;
@@ -79,13 +135,20 @@ class Track
 
 		std::string normalized_track_name(void) const;
 
-		bool read_tags(TagLib::Tag *pTag);
+		void set_artist(const std::string &artist);
+
+		bool read_tags(TagLib::Tag *pTag, LogBuffer &logBuffer);
+
+		bool retrieve_tags_any(LogBuffer &logBuffer,
+			TagLib::IOStream *pStream);
 
-		bool retrieve_tags_any(void);
+		bool retrieve_tags_mp3(LogBuffer &logBuffer,
+			TagLib::IOStream *pStream);
 
-		bool retrieve_tags_mp3(void);
+		bool read_mpeg_tags(TagLib::MPEG::File &mpegFile,
+			LogBuffer &logBuffer);
 
-		bool sort_by_artist(const Track &other) const;
+		bool sort_by_artist(const Track &other, TrackSort sort) const;
 
 		bool sort_by_album(const Track &other) const;
 
@@ -93,6 +156,14 @@ class Track
 
 		bool sort_by_mtime(const Track &other) const;
 
+		static void render_tracks(const std::vector<Track> &tracks,
+			const std::vector<unsigned int> *pTrackIndices,
+			std::string &output);
+
+		static void write_tracks(const std::string &outputFileName,
+			const std::vector<Track> &tracks,
+			const std::vector<unsigned int> *pTrackIndices);
+
 };
 
 #endif // _TRACK_H
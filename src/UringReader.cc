@@ -0,0 +1,432 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_LIBURING
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "Logger.h"
+#include "RunStats.h"
+#include "UringReader.h"
+
+using std::string;
+using std::vector;
+
+UringEntry::UringEntry(const string &name,
+	unsigned char type) :
+	m_name(name),
+	m_type(type),
+	m_statStatus(-ENOENT),
+	m_readHeader(false),
+	m_fd(-1),
+	m_pHeader(NULL),
+	m_headerLength(0)
+{
+	memset(&m_stat, 0, sizeof(struct stat));
+}
+
+// I/O state belongs to the original entry and isn't copied
+UringEntry::UringEntry(const UringEntry &other) :
+	m_name(other.m_name),
+	m_type(other.m_type),
+	m_statStatus(-ENOENT),
+	m_readHeader(false),
+	m_fd(-1),
+	m_pHeader(NULL),
+	m_headerLength(0)
+{
+	memset(&m_stat, 0, sizeof(struct stat));
+}
+
+UringEntry::~UringEntry()
+{
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+	if (m_pHeader != NULL)
+	{
+		delete[] m_pHeader;
+	}
+}
+
+UringEntry &UringEntry::operator=(const UringEntry &other)
+{
+	if (this != &other)
+	{
+		m_name = other.m_name;
+		m_type = other.m_type;
+	}
+
+	return *this;
+}
+
+HeaderStream *UringEntry::release_stream(const string &entryName)
+{
+	if (m_fd < 0)
+	{
+		return NULL;
+	}
+
+	HeaderStream *pStream = new HeaderStream(entryName, m_fd,
+		m_pHeader, (m_headerLength > 0 ? (size_t)m_headerLength : 0),
+		m_stat.st_size);
+
+	// The stream owns these now
+	m_fd = -1;
+	m_pHeader = NULL;
+	m_headerLength = 0;
+
+	return pStream;
+}
+
+UringReader::UringReader(unsigned int queueDepth) :
+	m_queueDepth(queueDepth),
+	m_ready(false),
+	m_statxBuffers(queueDepth)
+{
+	int status = io_uring_queue_init(m_queueDepth, &m_ring, 0);
+
+	if (status < 0)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to set up io_uring: " << strerror(-status);
+	}
+	else
+	{
+		m_ready = true;
+	}
+}
+
+UringReader::~UringReader()
+{
+	if (m_ready == true)
+	{
+		io_uring_queue_exit(&m_ring);
+	}
+}
+
+bool UringReader::is_ready(void) const
+{
+	return m_ready;
+}
+
+unsigned int UringReader::get_queue_depth(void) const
+{
+	return m_queueDepth;
+}
+
+void UringReader::stat_entries(int dirFd,
+	vector<UringEntry> &entries,
+	size_t firstEntry, size_t entriesCount)
+{
+	run_operations(URING_STATX, dirFd, entries, firstEntry, entriesCount);
+}
+
+void UringReader::read_headers(int dirFd,
+	vector<UringEntry> &entries,
+	size_t firstEntry, size_t entriesCount)
+{
+	// Files have to be opened before their headers can be read
+	run_operations(URING_OPEN, dirFd, entries, firstEntry, entriesCount);
+	run_operations(URING_READ, dirFd, entries, firstEntry, entriesCount);
+}
+
+void UringReader::run_operations(UringOperation operation,
+	int dirFd, vector<UringEntry> &entries,
+	size_t firstEntry, size_t entriesCount)
+{
+	size_t lastEntry = firstEntry + entriesCount;
+
+	if (lastEntry > entries.size())
+	{
+		lastEntry = entries.size();
+	}
+
+	vector<UringEntry*> submittedEntries(m_queueDepth, NULL);
+	size_t entryNum = firstEntry;
+
+	while (entryNum < lastEntry)
+	{
+		unsigned int submittedCount = 0;
+
+		// Queue as many operations as the ring can take
+		while ((entryNum < lastEntry) &&
+			(submittedCount < m_queueDepth))
+		{
+			UringEntry &entry = entries[entryNum];
+			struct io_uring_sqe *pSqe = NULL;
+
+			++entryNum;
+
+			if (operation == URING_STATX)
+			{
+				// Directories reported as such aren't stat'ed
+				if (entry.m_type == DT_DIR)
+				{
+					continue;
+				}
+
+				pSqe = io_uring_get_sqe(&m_ring);
+				if (pSqe == NULL)
+				{
+					--entryNum;
+					break;
+				}
+
+				// Links are followed
+				io_uring_prep_statx(pSqe, dirFd, entry.m_name.c_str(), 0,
+					STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME,
+					&m_statxBuffers[submittedCount]);
+			}
+			else if (operation == URING_OPEN)
+			{
+				if ((entry.m_readHeader == false) ||
+					(entry.m_statStatus != 0) ||
+					(S_ISREG(entry.m_stat.st_mode) == 0))
+				{
+					continue;
+				}
+
+				pSqe = io_uring_get_sqe(&m_ring);
+				if (pSqe == NULL)
+				{
+					--entryNum;
+					break;
+				}
+
+				io_uring_prep_openat(pSqe, dirFd, entry.m_name.c_str(),
+					O_RDONLY | O_CLOEXEC, 0);
+			}
+			else
+			{
+				if (entry.m_fd < 0)
+				{
+					continue;
+				}
+
+				size_t headerSize = m_headerSize;
+
+				if ((off_t)headerSize > entry.m_stat.st_size)
+				{
+					headerSize = (size_t)entry.m_stat.st_size;
+				}
+				if (headerSize == 0)
+				{
+					continue;
+				}
+
+				pSqe = io_uring_get_sqe(&m_ring);
+				if (pSqe == NULL)
+				{
+					--entryNum;
+					break;
+				}
+
+				entry.m_pHeader = new char[headerSize];
+				io_uring_prep_read(pSqe, entry.m_fd, entry.m_pHeader,
+					(unsigned int)headerSize, 0);
+			}
+
+			// Completions refer back to the entry and its statx buffer by position
+			io_uring_sqe_set_data(pSqe, (void *)(uintptr_t)submittedCount);
+			submittedEntries[submittedCount] = &entry;
+			++submittedCount;
+		}
+
+		// Either there was nothing left to do or the ring is full
+		if (submittedCount == 0)
+		{
+			break;
+		}
+
+		int status = io_uring_submit(&m_ring);
+		if (status < 0)
+		{
+			LogMessage(LOG_LEVEL_ERROR) << "Failed to submit io_uring operations: " << strerror(-status);
+			m_ready = false;
+			break;
+		}
+
+		vector<bool> completedEntries(submittedCount, false);
+		unsigned int completedCount = 0;
+
+		// Wait for all of them to complete
+		while (completedCount < submittedCount)
+		{
+			struct io_uring_cqe *pCqe = NULL;
+
+			status = io_uring_wait_cqe(&m_ring, &pCqe);
+			if (status == -EINTR)
+			{
+				continue;
+			}
+			else if (status < 0)
+			{
+				LogMessage(LOG_LEVEL_ERROR) << "Failed to wait for io_uring completions: " << strerror(-status);
+				m_ready = false;
+
+				// Entries and buffers can't go away while the kernel may still write to them
+				drain_operations(operation, submittedEntries, completedEntries,
+					submittedCount - completedCount);
+				break;
+			}
+
+			++completedCount;
+
+			uintptr_t submittedNum = (uintptr_t)io_uring_cqe_get_data(pCqe);
+			int result = pCqe->res;
+
+			io_uring_cqe_seen(&m_ring, pCqe);
+
+			if (submittedNum >= submittedCount)
+			{
+				continue;
+			}
+			completedEntries[submittedNum] = true;
+
+			UringEntry *pEntry = submittedEntries[submittedNum];
+
+			if (operation == URING_STATX)
+			{
+				const struct statx &entryStatx = m_statxBuffers[submittedNum];
+
+				if (result == 0)
+				{
+					memset(&pEntry->m_stat, 0, sizeof(struct stat));
+					pEntry->m_stat.st_mode = entryStatx.stx_mode;
+					pEntry->m_stat.st_size = (off_t)entryStatx.stx_size;
+					pEntry->m_stat.st_mtime = (time_t)entryStatx.stx_mtime.tv_sec;
+				}
+				pEntry->m_statStatus = result;
+			}
+			else if (operation == URING_OPEN)
+			{
+				pEntry->m_fd = result;
+			}
+			else
+			{
+				pEntry->m_headerLength = result;
+				if (result > 0)
+				{
+					RunStats::add_count("bytes_read", (unsigned long long)result);
+				}
+			}
+		}
+
+		if (m_ready == false)
+		{
+			break;
+		}
+	}
+}
+
+void UringReader::drain_operations(UringOperation operation,
+	vector<UringEntry*> &submittedEntries,
+	vector<bool> &completedEntries, unsigned int outstandingCount)
+{
+	unsigned int submittedCount = (unsigned int)completedEntries.size();
+	unsigned int cancelCount = 0;
+
+	// Ask for whatever is still in flight to be cancelled
+	for (unsigned int submittedNum = 0; submittedNum < submittedCount; ++submittedNum)
+	{
+		if (completedEntries[submittedNum] == true)
+		{
+			continue;
+		}
+
+		struct io_uring_sqe *pSqe = io_uring_get_sqe(&m_ring);
+		if (pSqe == NULL)
+		{
+			break;
+		}
+
+		io_uring_prep_cancel(pSqe, (void *)(uintptr_t)submittedNum, 0);
+		// Cancellations complete too, with a position no operation has
+		io_uring_sqe_set_data(pSqe, (void *)(uintptr_t)m_queueDepth);
+		++cancelCount;
+	}
+
+	if ((cancelCount > 0) &&
+		(io_uring_submit(&m_ring) < 0))
+	{
+		cancelCount = 0;
+	}
+
+	// Cancelled or not, operations complete before the kernel lets go of their buffers
+	unsigned int pendingCount = outstandingCount + cancelCount;
+	while (pendingCount > 0)
+	{
+		struct io_uring_cqe *pCqe = NULL;
+
+		int status = io_uring_wait_cqe(&m_ring, &pCqe);
+		if (status == -EINTR)
+		{
+			continue;
+		}
+		else if (status < 0)
+		{
+			break;
+		}
+
+		uintptr_t submittedNum = (uintptr_t)io_uring_cqe_get_data(pCqe);
+		int result = pCqe->res;
+
+		io_uring_cqe_seen(&m_ring, pCqe);
+		--pendingCount;
+
+		if ((submittedNum < submittedCount) &&
+			(completedEntries[submittedNum] == false))
+		{
+			completedEntries[submittedNum] = true;
+			--outstandingCount;
+
+			// Files opened anyway are closed with their entry
+			if ((operation == URING_OPEN) &&
+				(result >= 0))
+			{
+				submittedEntries[submittedNum]->m_fd = result;
+			}
+		}
+	}
+
+	if (outstandingCount == 0)
+	{
+		return;
+	}
+
+	LogMessage(LOG_LEVEL_ERROR) << "Giving up on " << outstandingCount << " io_uring operation(s)";
+
+	// The kernel may still write to these, so they are leaked rather than freed
+	for (unsigned int submittedNum = 0; submittedNum < submittedCount; ++submittedNum)
+	{
+		if (completedEntries[submittedNum] == false)
+		{
+			submittedEntries[submittedNum]->m_pHeader = NULL;
+		}
+	}
+	(new vector<struct statx>(m_queueDepth))->swap(m_statxBuffers);
+}
+
+size_t UringReader::m_headerSize = 65536;
+#endif
@@ -0,0 +1,99 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _URING_READER_H
+#define _URING_READER_H
+
+#ifdef HAVE_LIBURING
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <liburing.h>
+#include <string>
+#include <vector>
+
+#include "HeaderStream.h"
+
+class UringEntry
+{
+	public:
+		UringEntry(const std::string &name,
+			unsigned char type);
+		UringEntry(const UringEntry &other);
+		virtual ~UringEntry();
+
+		UringEntry &operator=(const UringEntry &other);
+
+		HeaderStream *release_stream(const std::string &entryName);
+
+		std::string m_name;
+		unsigned char m_type;
+		int m_statStatus;
+		struct stat m_stat;
+		bool m_readHeader;
+		int m_fd;
+		char *m_pHeader;
+		ssize_t m_headerLength;
+
+};
+
+// Keeps statx, openat and read operations in flight for a batch of directory entries
+class UringReader
+{
+	public:
+		UringReader(unsigned int queueDepth);
+		virtual ~UringReader();
+
+		bool is_ready(void) const;
+
+		unsigned int get_queue_depth(void) const;
+
+		void stat_entries(int dirFd,
+			std::vector<UringEntry> &entries,
+			size_t firstEntry, size_t entriesCount);
+
+		void read_headers(int dirFd,
+			std::vector<UringEntry> &entries,
+			size_t firstEntry, size_t entriesCount);
+
+		static size_t m_headerSize;
+
+	protected:
+		typedef enum { URING_STATX = 0, URING_OPEN, URING_READ } UringOperation;
+
+		struct io_uring m_ring;
+		unsigned int m_queueDepth;
+		bool m_ready;
+		std::vector<struct statx> m_statxBuffers;
+
+		void run_operations(UringOperation operation,
+			int dirFd, std::vector<UringEntry> &entries,
+			size_t firstEntry, size_t entriesCount);
+
+		void drain_operations(UringOperation operation,
+			std::vector<UringEntry*> &submittedEntries,
+			std::vector<bool> &completedEntries,
+			unsigned int outstandingCount);
+
+	private:
+		UringReader(const UringReader &other);
+		UringReader &operator=(const UringReader &other);
+
+};
+#endif
+
+#endif // _URING_READER_H
@@ -16,28 +16,75 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
-#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utf8proc.h>
 #include <algorithm>
-#include <fstream>
 #include <iostream>
+#include <new>
 
 #include "Utilities.h"
 
-using std::for_each;
-using std::ios;
-using std::ifstream;
-using std::streamsize;
+using std::less;
+using std::set;
 using std::string;
+using std::vector;
 
-// A function object to lower case strings with for_each()
-struct ToLowerFunc
+static const uint64_t g_highBits = 0x8080808080808080ULL;
+
+// Lower cases the ASCII letters in 8 bytes at once, none of which may have its high bit set.
+// Adding 0x3F sets the high bit of bytes from 'A' up, adding 0x25 that of bytes past 'Z'
+static inline uint64_t lower_ascii_word(uint64_t word)
+{
+	uint64_t fromA = word + 0x3F3F3F3F3F3F3F3FULL;
+	uint64_t pastZ = word + 0x2525252525252525ULL;
+
+	return word | (((fromA & ~pastZ) & g_highBits) >> 2);
+}
+
+// Lower cases ASCII letters in place, eight at a time, and returns where the first non-ASCII byte is
+static size_t lower_ascii(char *pData, size_t length)
 {
-	public:
-		void operator()(char &c)
+	size_t pos = 0;
+
+	while (pos + sizeof(uint64_t) <= length)
+	{
+		uint64_t word;
+
+		memcpy(&word, pData + pos, sizeof(uint64_t));
+		if ((word & g_highBits) != 0)
 		{
-			c = (char)tolower((int)c);
+			break;
 		}
-};
+
+		word = lower_ascii_word(word);
+		memcpy(pData + pos, &word, sizeof(uint64_t));
+		pos += sizeof(uint64_t);
+	}
+
+	for (; pos < length; ++pos)
+	{
+		unsigned char c = (unsigned char)pData[pos];
+
+		if (c >= 0x80)
+		{
+			break;
+		}
+		else if ((c >= 'A') &&
+			(c <= 'Z'))
+		{
+			pData[pos] = (char)(c + ('a' - 'A'));
+		}
+	}
+
+	return pos;
+}
 
 string to_lower_case(const string &str)
 {
@@ -47,12 +94,73 @@ string to_lower_case(const string &str)
 	}
 
 	string tmp(str);
+	char *pData = &tmp[0];
+	size_t length = tmp.length();
+	size_t pos = lower_ascii(pData, length);
 
-	for_each(tmp.begin(), tmp.end(), ToLowerFunc());
+	// Non-ASCII bytes are left alone
+	while (pos < length)
+	{
+		++pos;
+		pos += lower_ascii(pData + pos, length - pos);
+	}
 
 	return tmp;
 }
 
+string fold_case(const string &str)
+{
+	if (str.empty() == true)
+	{
+		return str;
+	}
+
+	string tmp(str);
+	char *pData = &tmp[0];
+	size_t length = tmp.length();
+	size_t pos = lower_ascii(pData, length);
+
+	// Most strings are pure ASCII
+	if (pos == length)
+	{
+		return tmp;
+	}
+
+	// Combining marks compose with the character before them, which may be ASCII,
+	// so utf8proc gets the rest of the string from there on
+	if (pos > 0)
+	{
+		--pos;
+	}
+
+	string folded(tmp, 0, pos);
+	utf8proc_uint8_t *pFolded = NULL;
+	utf8proc_ssize_t foldedLength = utf8proc_map((const utf8proc_uint8_t *)pData + pos,
+		(utf8proc_ssize_t)(length - pos), &pFolded, (utf8proc_option_t)(UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_CASEFOLD));
+
+	if ((foldedLength >= 0) &&
+		(pFolded != NULL))
+	{
+		folded.append((const char *)pFolded, (size_t)foldedLength);
+	}
+	else
+	{
+		// Not valid UTF-8, only lower case ASCII characters
+		while (pos < length)
+		{
+			++pos;
+			pos += lower_ascii(pData + pos, length - pos);
+		}
+		folded = tmp;
+	}
+	if (pFolded != NULL)
+	{
+		free(pFolded);
+	}
+
+	return folded;
+}
+
 string clean_file_name(const string &outputFileName)
 {
 	string illegalChars("#$+%!`&'*?<>|/\\{}\"=:@");
@@ -69,36 +177,512 @@ string clean_file_name(const string &outputFileName)
 	return fileName;
 }
 
-char *load_stream(ifstream &inputStream,
-	off_t &length)
+static unsigned int utf8_to_code_point(const char *&pChar, const char *pEnd)
+{
+	const unsigned int replacementChar = 0xFFFD;
+	unsigned int firstByte = (unsigned char)pChar[0];
+
+	if (firstByte < 0x80)
+	{
+		return firstByte;
+	}
+	else if (firstByte < 0xE0)
+	{
+		if (pEnd - pChar < 2)
+		{
+			return replacementChar;
+		}
+
+		unsigned int codePoint = ((firstByte & 0x1F) << 6) |
+			((unsigned char)pChar[1] & 0x3F);
+		pChar += 1;
+
+		// Overlong encodings are invalid
+		return (codePoint < 0x80 ? replacementChar : codePoint);
+	}
+	else if (firstByte < 0xF0)
+	{
+		if (pEnd - pChar < 3)
+		{
+			return replacementChar;
+		}
+
+		unsigned int codePoint = ((firstByte & 0x0F) << 12) |
+			(((unsigned char)pChar[1] & 0x3F) << 6) |
+			((unsigned char)pChar[2] & 0x3F);
+		pChar += 2;
+
+		// So are surrogates
+		if ((codePoint >= 0xD800) &&
+			(codePoint <= 0xDFFF))
+		{
+			return replacementChar;
+		}
+
+		return (codePoint < 0x800 ? replacementChar : codePoint);
+	}
+	else if (firstByte < 0xF8)
+	{
+		if (pEnd - pChar < 4)
+		{
+			return replacementChar;
+		}
+
+		unsigned int codePoint = ((firstByte & 0x07) << 18) |
+			(((unsigned char)pChar[1] & 0x3F) << 12) |
+			(((unsigned char)pChar[2] & 0x3F) << 6) |
+			((unsigned char)pChar[3] & 0x3F);
+		pChar += 3;
+
+		return (codePoint < 0x10000 ? replacementChar : codePoint);
+	}
+
+	return replacementChar;
+}
+
+static void append_unicode_escape(unsigned int codePoint, string &output)
+{
+	const char *pHexDigits = "0123456789abcdef";
+
+	output += "\\u";
+	output += pHexDigits[(codePoint >> 12) & 0xF];
+	output += pHexDigits[(codePoint >> 8) & 0xF];
+	output += pHexDigits[(codePoint >> 4) & 0xF];
+	output += pHexDigits[codePoint & 0xF];
+}
+
+void append_utf8(unsigned int codePoint, string &str)
+{
+	if (codePoint <= 0x7F)
+	{
+		str += (char)codePoint;
+	}
+	else if (codePoint <= 0x7FF)
+	{
+		str += (char)(0xC0 | (codePoint >> 6));
+		str += (char)(0x80 | (codePoint & 0x3F));
+	}
+	else if (codePoint <= 0xFFFF)
+	{
+		str += (char)(0xE0 | (codePoint >> 12));
+		str += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		str += (char)(0x80 | (codePoint & 0x3F));
+	}
+	else if (codePoint <= 0x10FFFF)
+	{
+		str += (char)(0xF0 | (codePoint >> 18));
+		str += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+		str += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		str += (char)(0x80 | (codePoint & 0x3F));
+	}
+}
+
+// Escapes the same way Json::FastWriter does, non-ASCII characters included
+void append_json_string(const string &str, string &output)
+{
+	const char *pEnd = str.data() + str.length();
+
+	output += '"';
+
+	for (const char *pChar = str.data(); pChar < pEnd; ++pChar)
+	{
+		switch (*pChar)
+		{
+			case '"':
+				output += "\\\"";
+				break;
+			case '\\':
+				output += "\\\\";
+				break;
+			case '\b':
+				output += "\\b";
+				break;
+			case '\f':
+				output += "\\f";
+				break;
+			case '\n':
+				output += "\\n";
+				break;
+			case '\r':
+				output += "\\r";
+				break;
+			case '\t':
+				output += "\\t";
+				break;
+			default:
+			{
+				unsigned int codePoint = utf8_to_code_point(pChar, pEnd);
+
+				if ((codePoint >= 0x20) &&
+					(codePoint < 0x80))
+				{
+					output += (char)codePoint;
+				}
+				else if (codePoint < 0x10000)
+				{
+					append_unicode_escape(codePoint, output);
+				}
+				else
+				{
+					// Outside the BMP, use a surrogate pair
+					codePoint -= 0x10000;
+					append_unicode_escape(0xD800 + ((codePoint >> 10) & 0x3FF), output);
+					append_unicode_escape(0xDC00 + (codePoint & 0x3FF), output);
+				}
+				break;
+			}
+		}
+	}
+
+	output += '"';
+}
+
+string escape_field(const string &field)
+{
+	string escapedField;
+
+	escapedField.reserve(field.length());
+	for (string::const_iterator charIter = field.begin();
+		charIter != field.end(); ++charIter)
+	{
+		switch (*charIter)
+		{
+			case '\\':
+				escapedField += "\\\\";
+				break;
+			case '\t':
+				escapedField += "\\t";
+				break;
+			case '\n':
+				escapedField += "\\n";
+				break;
+			case '\r':
+				escapedField += "\\r";
+				break;
+			default:
+				escapedField += *charIter;
+				break;
+		}
+	}
+
+	return escapedField;
+}
+
+string unescape_field(const string &field)
+{
+	string unescapedField;
+
+	unescapedField.reserve(field.length());
+	for (string::size_type pos = 0; pos < field.length(); ++pos)
+	{
+		if ((field[pos] != '\\') ||
+			(pos + 1 >= field.length()))
+		{
+			unescapedField += field[pos];
+			continue;
+		}
+
+		++pos;
+		switch (field[pos])
+		{
+			case 't':
+				unescapedField += '\t';
+				break;
+			case 'n':
+				unescapedField += '\n';
+				break;
+			case 'r':
+				unescapedField += '\r';
+				break;
+			default:
+				unescapedField += field[pos];
+				break;
+		}
+	}
+
+	return unescapedField;
+}
+
+void split_line(const string &line, vector<string> &fields)
 {
-	inputStream.seekg(0, ios::end);
-	length = (off_t)inputStream.tellg();
-	inputStream.seekg(0, ios::beg);
+	string::size_type startPos = 0, tabPos = line.find('\t');
+
+	while (tabPos != string::npos)
+	{
+		fields.push_back(line.substr(startPos, tabPos - startPos));
 
-	char *pBuffer = new char[length + 1];
-	inputStream.read(pBuffer, (streamsize)length);
-	if (inputStream.fail() == false)
+		startPos = tabPos + 1;
+		tabPos = line.find('\t', startPos);
+	}
+	fields.push_back(line.substr(startPos));
+}
+
+// FNV-1a, chained through the hash of previous strings
+uint64_t hash_string(const string &str, uint64_t hash)
+{
+	for (string::const_iterator charIter = str.begin();
+		charIter != str.end(); ++charIter)
 	{
-		pBuffer[length] = '\0';
-		return pBuffer;
+		hash ^= (uint64_t)(unsigned char)*charIter;
+		hash *= 1099511628211ULL;
 	}
 
-	return NULL;
+	return hash;
 }
 
-char *load_file(const string &fileName,
-	off_t &length)
+MappedFile::MappedFile(const string &fileName) :
+	m_pData(NULL),
+	m_length(0),
+	m_isOpen(false),
+	m_isMapped(false)
 {
-	ifstream fileStream;
+	int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return;
+	}
 
-	fileStream.open(fileName.c_str());
-	if (fileStream.good() == true)
+	struct stat fileStat;
+
+	if ((fstat(fd, &fileStat) == 0) &&
+		(S_ISREG(fileStat.st_mode)))
 	{
-			return load_stream(fileStream, length);
+		m_length = fileStat.st_size;
+		if (m_length == 0)
+		{
+			m_isOpen = true;
+		}
+		else
+		{
+			void *pData = mmap(NULL, (size_t)m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (pData != MAP_FAILED)
+			{
+				m_pData = (char *)pData;
+				m_isOpen = m_isMapped = true;
+
+				madvise(pData, (size_t)m_length, MADV_SEQUENTIAL);
+			}
+		}
+	}
+
+	// Pipes and the like can't be mapped
+	if (m_isOpen == false)
+	{
+		m_isOpen = read_file(fd);
 	}
-	fileStream.close();
 
-	return NULL;
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_pData != NULL)
+	{
+		if (m_isMapped == true)
+		{
+			munmap(m_pData, (size_t)m_length);
+		}
+		else
+		{
+			delete[] m_pData;
+		}
+	}
+}
+
+bool MappedFile::is_open(void) const
+{
+	return m_isOpen;
+}
+
+const char *MappedFile::get_data(void) const
+{
+	return m_pData;
+}
+
+off_t MappedFile::get_length(void) const
+{
+	return m_length;
+}
+
+bool MappedFile::read_file(int fd)
+{
+	size_t bufferSize = 65536;
+	char *pBuffer = new char[bufferSize];
+
+	m_length = 0;
+
+	while (true)
+	{
+		if ((size_t)m_length == bufferSize)
+		{
+			char *pLargerBuffer = new char[bufferSize * 2];
+
+			memcpy(pLargerBuffer, pBuffer, bufferSize);
+			delete[] pBuffer;
+
+			pBuffer = pLargerBuffer;
+			bufferSize *= 2;
+		}
+
+		ssize_t bytesRead = read(fd, pBuffer + m_length, bufferSize - (size_t)m_length);
+
+		if (bytesRead == 0)
+		{
+			break;
+		}
+		else if (bytesRead < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			delete[] pBuffer;
+			m_length = 0;
+
+			return false;
+		}
+
+		m_length += bytesRead;
+	}
+
+	m_pData = pBuffer;
+
+	return true;
+}
+
+Arena::Arena(size_t blockSize) :
+	m_blockSize(blockSize),
+	m_pCurrent(NULL),
+	m_available(0),
+	m_allocationsCount(0),
+	m_usedSize(0)
+{
+}
+
+Arena::~Arena()
+{
+	release();
+}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+	size_t padding = 0;
+
+	if (size == 0)
+	{
+		size = 1;
+	}
+
+	if (m_pCurrent != NULL)
+	{
+		padding = (alignment - ((size_t)m_pCurrent % alignment)) % alignment;
+	}
+
+	if ((m_pCurrent == NULL) ||
+		(padding + size > m_available))
+	{
+		// Large requests get a block of their own, and the current block is kept
+		bool ownBlock = (size > m_blockSize / 4);
+		size_t blockSize = (ownBlock == true ? size : m_blockSize);
+		// malloc() returns memory aligned for any standard type
+		char *pBlock = (char*)malloc(blockSize);
+
+		if (pBlock == NULL)
+		{
+			throw std::bad_alloc();
+		}
+		m_blocks.push_back(pBlock);
+
+		if (ownBlock == true)
+		{
+			++m_allocationsCount;
+			m_usedSize += size;
+
+			return pBlock;
+		}
+
+		m_pCurrent = pBlock;
+		m_available = blockSize;
+		padding = 0;
+	}
+
+	char *pMemory = m_pCurrent + padding;
+
+	m_pCurrent = pMemory + size;
+	m_available -= padding + size;
+	++m_allocationsCount;
+	m_usedSize += size;
+
+	return pMemory;
+}
+
+void Arena::release(void)
+{
+	for (vector<char*>::iterator blockIter = m_blocks.begin();
+		blockIter != m_blocks.end(); ++blockIter)
+	{
+		free(*blockIter);
+	}
+	m_blocks.clear();
+
+	m_pCurrent = NULL;
+	m_available = 0;
+	m_allocationsCount = 0;
+	m_usedSize = 0;
+}
+
+size_t Arena::get_allocations_count(void) const
+{
+	return m_allocationsCount;
+}
+
+size_t Arena::get_blocks_count(void) const
+{
+	return m_blocks.size();
+}
+
+size_t Arena::get_used_size(void) const
+{
+	return m_usedSize;
+}
+
+const string *StringPool::intern(const string &str)
+{
+	// All empty strings share the same copy
+	if (str.empty() == true)
+	{
+		return get_empty();
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	const string *pStr = &(*m_strings.insert(str).first);
+	pthread_mutex_unlock(&m_mutex);
+
+	return pStr;
+}
+
+const string *StringPool::get_empty(void)
+{
+	static const string emptyStr;
+
+	return &emptyStr;
+}
+
+size_t StringPool::get_count(void)
+{
+	size_t stringsCount = 0;
+
+	pthread_mutex_lock(&m_mutex);
+	stringsCount = m_strings.size();
+	pthread_mutex_unlock(&m_mutex);
+
+	return stringsCount;
 }
 
+// The arena is defined first so that it's constructed before the set
+Arena StringPool::m_arena;
+set<string, less<string>, ArenaAllocator<string> > StringPool::m_strings(less<string>(),
+	ArenaAllocator<string>(StringPool::m_arena));
+pthread_mutex_t StringPool::m_mutex = PTHREAD_MUTEX_INITIALIZER;
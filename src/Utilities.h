@@ -19,15 +19,183 @@
 #ifndef _UTILITIES_H
 #define _UTILITIES_H
 
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <iostream>
+#include <new>
+#include <set>
 #include <string>
+#include <vector>
 
+// Only lower cases ASCII letters, for file extensions and the like
 std::string to_lower_case(const std::string &str);
 
+// Folds case the Unicode way, so that "BJÖRK" and "Björk" compare equal. ASCII runs are folded eight bytes at a time
+std::string fold_case(const std::string &str);
+
 std::string clean_file_name(const std::string &outputFileName);
 
-char *load_stream(std::ifstream &inputStream, off_t &length);
+void append_utf8(unsigned int codePoint, std::string &str);
+
+void append_json_string(const std::string &str, std::string &output);
+
+std::string escape_field(const std::string &field);
+
+std::string unescape_field(const std::string &field);
+
+void split_line(const std::string &line, std::vector<std::string> &fields);
+
+uint64_t hash_string(const std::string &str, uint64_t hash = 14695981039346656037ULL);
+
+// A read-only view of a file's contents, mapped in memory when possible
+class MappedFile
+{
+	public:
+		MappedFile(const std::string &fileName);
+		virtual ~MappedFile();
+
+		bool is_open(void) const;
+
+		const char *get_data(void) const;
+
+		off_t get_length(void) const;
+
+	protected:
+		char *m_pData;
+		off_t m_length;
+		bool m_isOpen;
+		bool m_isMapped;
+
+		bool read_file(int fd);
+
+	private:
+		MappedFile(const MappedFile &other);
+		MappedFile &operator=(const MappedFile &other);
+
+};
+
+// Hands memory out of large blocks that are only released all at once,
+// for data that lives as long as the crawl. It isn't thread-safe, so
+// track strings, which are set on worker threads, don't come from it
+class Arena
+{
+	public:
+		Arena(size_t blockSize = 65536);
+		virtual ~Arena();
+
+		void *allocate(size_t size, size_t alignment);
+
+		void release(void);
+
+		size_t get_allocations_count(void) const;
+
+		size_t get_blocks_count(void) const;
+
+		size_t get_used_size(void) const;
+
+	protected:
+		size_t m_blockSize;
+		std::vector<char*> m_blocks;
+		char *m_pCurrent;
+		size_t m_available;
+		size_t m_allocationsCount;
+		size_t m_usedSize;
+
+	private:
+		Arena(const Arena &other);
+		Arena &operator=(const Arena &other);
+
+};
+
+// Lets standard containers allocate from an Arena, deallocating does nothing.
+// Without an arena, it falls back to the heap
+template<typename T>
+class ArenaAllocator
+{
+	public:
+		typedef T value_type;
+
+		template<typename U>
+		struct rebind
+		{
+			typedef ArenaAllocator<U> other;
+		};
+
+		ArenaAllocator(Arena &arena) :
+			m_pArena(&arena)
+		{
+		}
+		ArenaAllocator(Arena *pArena) :
+			m_pArena(pArena)
+		{
+		}
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U> &other) :
+			m_pArena(other.m_pArena)
+		{
+		}
+
+		T *allocate(size_t count)
+		{
+			if (count > (size_t)-1 / sizeof(T))
+			{
+				throw std::bad_alloc();
+			}
+
+			if (m_pArena == NULL)
+			{
+				return static_cast<T*>(::operator new(count * sizeof(T)));
+			}
+
+			return static_cast<T*>(m_pArena->allocate(count * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T *pObjects, size_t)
+		{
+			// Otherwise memory is released with the arena
+			if (m_pArena == NULL)
+			{
+				::operator delete(pObjects);
+			}
+		}
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U> &other) const
+		{
+			return m_pArena == other.m_pArena;
+		}
+
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U> &other) const
+		{
+			return m_pArena != other.m_pArena;
+		}
+
+		Arena *m_pArena;
+
+};
+
+// Keeps a single copy of strings that repeat across tracks, until the program exits
+class StringPool
+{
+	public:
+		static const std::string *intern(const std::string &str);
+
+		static const std::string *get_empty(void);
+
+		static size_t get_count(void);
+
+	protected:
+		static Arena m_arena;
+		static std::set<std::string, std::less<std::string>, ArenaAllocator<std::string> > m_strings;
+		static pthread_mutex_t m_mutex;
+
+	private:
+		StringPool();
+		StringPool(const StringPool &other);
+		StringPool &operator=(const StringPool &other);
 
-char *load_file(const std::string &fileName, off_t &length);
+};
 
 #endif // _UTILITIES_H
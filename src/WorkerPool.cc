@@ -0,0 +1,175 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <iostream>
+
+#include "Logger.h"
+#include "WorkerPool.h"
+
+using std::deque;
+using std::vector;
+
+WorkerJob::WorkerJob() :
+	m_done(false)
+{
+}
+
+WorkerJob::~WorkerJob()
+{
+}
+
+WorkerPool::WorkerPool(unsigned int workersCount) :
+	m_stop(false)
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_queuedCond, NULL);
+	pthread_cond_init(&m_doneCond, NULL);
+
+	for (unsigned int threadNum = 0; threadNum < workersCount; ++threadNum)
+	{
+		pthread_t threadId;
+
+		if (pthread_create(&threadId, NULL, worker_thread, (void *)this) != 0)
+		{
+			LogMessage(LOG_LEVEL_ERROR) << "Failed to start worker thread " << threadNum;
+			break;
+		}
+
+		m_threads.push_back(threadId);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stop = true;
+	pthread_cond_broadcast(&m_queuedCond);
+	pthread_mutex_unlock(&m_mutex);
+
+	for (vector<pthread_t>::const_iterator threadIter = m_threads.begin();
+		threadIter != m_threads.end(); ++threadIter)
+	{
+		pthread_join(*threadIter, NULL);
+	}
+
+	// Jobs that were never popped are ours to delete
+	for (deque<WorkerJob*>::const_iterator jobIter = m_jobs.begin();
+		jobIter != m_jobs.end(); ++jobIter)
+	{
+		delete *jobIter;
+	}
+
+	pthread_cond_destroy(&m_doneCond);
+	pthread_cond_destroy(&m_queuedCond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void *WorkerPool::worker_thread(void *pData)
+{
+	WorkerPool *pPool = (WorkerPool *)pData;
+
+	if (pPool != NULL)
+	{
+		pPool->run_jobs();
+	}
+
+	return NULL;
+}
+
+void WorkerPool::run_jobs(void)
+{
+	pthread_mutex_lock(&m_mutex);
+
+	while (m_stop == false)
+	{
+		if (m_queuedJobs.empty() == true)
+		{
+			pthread_cond_wait(&m_queuedCond, &m_mutex);
+			continue;
+		}
+
+		WorkerJob *pJob = m_queuedJobs.front();
+
+		m_queuedJobs.pop_front();
+		pthread_mutex_unlock(&m_mutex);
+
+		pJob->run();
+
+		pthread_mutex_lock(&m_mutex);
+		pJob->m_done = true;
+		pthread_cond_broadcast(&m_doneCond);
+	}
+
+	pthread_mutex_unlock(&m_mutex);
+}
+
+bool WorkerPool::push_job(WorkerJob *pJob)
+{
+	if ((pJob == NULL) ||
+		(m_threads.empty() == true))
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_jobs.push_back(pJob);
+	m_queuedJobs.push_back(pJob);
+	pthread_cond_signal(&m_queuedCond);
+	pthread_mutex_unlock(&m_mutex);
+
+	return true;
+}
+
+WorkerJob *WorkerPool::pop_job(bool wait)
+{
+	WorkerJob *pJob = NULL;
+
+	pthread_mutex_lock(&m_mutex);
+
+	// Only the oldest job may be returned, even if more recent ones are done
+	while (m_jobs.empty() == false)
+	{
+		if (m_jobs.front()->m_done == true)
+		{
+			pJob = m_jobs.front();
+			m_jobs.pop_front();
+			break;
+		}
+		else if (wait == false)
+		{
+			break;
+		}
+
+		pthread_cond_wait(&m_doneCond, &m_mutex);
+	}
+
+	pthread_mutex_unlock(&m_mutex);
+
+	return pJob;
+}
+
+unsigned int WorkerPool::get_jobs_count(void)
+{
+	unsigned int jobsCount = 0;
+
+	pthread_mutex_lock(&m_mutex);
+	jobsCount = (unsigned int)m_jobs.size();
+	pthread_mutex_unlock(&m_mutex);
+
+	return jobsCount;
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright 2021-2025 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+class WorkerJob
+{
+	public:
+		WorkerJob();
+		virtual ~WorkerJob();
+
+		virtual void run(void) = 0;
+
+	protected:
+		bool m_done;
+
+		friend class WorkerPool;
+
+	private:
+		WorkerJob(const WorkerJob &other);
+		WorkerJob &operator=(const WorkerJob &other);
+
+};
+
+// Runs jobs on a fixed number of threads and hands them back in the order they were pushed
+class WorkerPool
+{
+	public:
+		WorkerPool(unsigned int workersCount);
+		virtual ~WorkerPool();
+
+		bool push_job(WorkerJob *pJob);
+
+		WorkerJob *pop_job(bool wait);
+
+		unsigned int get_jobs_count(void);
+
+	protected:
+		std::vector<pthread_t> m_threads;
+		std::deque<WorkerJob*> m_queuedJobs;
+		std::deque<WorkerJob*> m_jobs;
+		pthread_mutex_t m_mutex;
+		pthread_cond_t m_queuedCond;
+		pthread_cond_t m_doneCond;
+		bool m_stop;
+
+		static void *worker_thread(void *pData);
+
+		void run_jobs(void);
+
+	private:
+		WorkerPool(const WorkerPool &other);
+		WorkerPool &operator=(const WorkerPool &other);
+
+};
+
+#endif // _WORKER_POOL_H
@@ -25,6 +25,8 @@
 #include <utility>
 
 #include "BandcampMusicCrawler.h"
+#include "Logger.h"
+#include "RunStats.h"
 #include "Track.h"
 #include "Utilities.h"
 
@@ -35,14 +37,24 @@ using std::string;
 using std::vector;
 
 static struct option g_longOptions[] = {
+    {"cache", 1, 0, 'C'},
     {"covers", 0, 0, 'c'},
     {"max-depth", 0, 0, 'd'},
+    {"extensions", 1, 0, 'e'},
     {"from", 1, 0, 'f'},
     {"help", 0, 0, 'h'},
+    {"journal", 1, 0, 'J'},
+    {"jobs", 1, 0, 'j'},
     {"lookup", 1, 0, 'l'},
     {"music-library", 1, 0, 'm'},
     {"output-directory", 1, 0, 'o'},
+    {"problems", 1, 0, 'p'},
+    {"quiet", 0, 0, 'q'},
+    {"stats", 1, 0, 'S'},
+    {"uring", 1, 0, 'u'},
+    {"verbose", 0, 0, 'V'},
     {"version", 0, 0, 'v'},
+    {"watch", 1, 0, 'w'},
     {0, 0, 0, 0}
 };
 
@@ -55,52 +67,46 @@ static bool parse_items(const string &topLevelDirName,
 		return false;
 	}
 
-	off_t length = 0;
+	BandcampCollection collection;
 
-	clog << "Opening collection file " << inputFileName << endl;
+	LogMessage(LOG_LEVEL_INFO) << "Opening collection file " << inputFileName;
 
-	// Slurp the whole file
-	char *pCollection = load_file(inputFileName, length);
-	char *pLookup = NULL;
-
-	if (pCollection == NULL)
+	// Only keep what's needed of each item
+	if (collection.load(inputFileName) == false)
 	{
 		return false;
 	}
 
-	if (length == 0)
+	if (BandcampMusicCrawler::m_lookupFileName.empty() == false)
 	{
-		delete[] pCollection;
+		LogMessage(LOG_LEVEL_INFO) << "Opening lookup file " << BandcampMusicCrawler::m_lookupFileName;
 
-		return false;
-	}
+		MappedFile lookupFile(BandcampMusicCrawler::m_lookupFileName);
 
-	length = 0;
-	if (BandcampMusicCrawler::m_lookupFileName.empty() == false)
-	{
-		clog << "Opening lookup file " << BandcampMusicCrawler::m_lookupFileName << endl;
+		if ((lookupFile.is_open() == true) &&
+			(lookupFile.get_length() > 0))
+		{
+			BandcampMusicCrawler crawler(topLevelDirName, collection,
+				lookupFile.get_data(), lookupFile.get_length());
 
-		pLookup = load_file(BandcampMusicCrawler::m_lookupFileName, length);
-	}
+			crawler.crawl();
 
-	if ((pLookup != NULL) &&
-		(length > 0))
-	{
-		BandcampMusicCrawler crawler(topLevelDirName, pCollection, pLookup);
+			if (MusicFolderCrawler::m_watchDelay > 0)
+			{
+				crawler.watch();
+			}
 
-		crawler.crawl();
+			return true;
+		}
 	}
-	else
-	{
-		BandcampMusicCrawler crawler(topLevelDirName, pCollection);
 
-		crawler.crawl();
-	}
+	BandcampMusicCrawler crawler(topLevelDirName, collection);
+
+	crawler.crawl();
 
-	delete[] pCollection;
-	if (pLookup != NULL)
+	if (MusicFolderCrawler::m_watchDelay > 0)
 	{
-		delete[] pLookup;
+		crawler.watch();
 	}
 
 	return true;
@@ -111,30 +117,47 @@ static void print_help(void)
 	clog << "mpbandcamp - Bandcamp collection to mpd playlists generator\n\n"
 		<< "Usage: mpbandcamp [OPTIONS] MUSIC_DIRECTORY COLLECTION_JSON_FILE_NAME\n\n"
 		<< "Options:\n"
+		<< "  -C, --cache FILE_NAME         file to cache tags in between runs\n"
 		<< "  -c, --covers                  try and identify covers\n"
 		<< "  -d, --max-depth               maximum depth when in browse mode\n"
+		<< "  -e, --extensions LIST         comma separated list of extensions of files to read tags from\n"
 		<< "  -f, --from EXISTING_PATH      path to replace\n"
 		<< "  -h, --help                    display this help and exit\n"
+		<< "  -J, --journal FILE_NAME       file to record playlists in, so that unchanged ones aren't written again\n"
+		<< "  -j, --jobs NUM                number of threads to read tags and sort playlists with, defaults to 1\n"
 		<< "  -l, --lookup FILE_NAME        file to lookup metadata mismatches in\n"
 		<< "  -m, --music-library NAME      name of the music library this is for, defaults to INTERNAL\n"
 		<< "  -o, --output-directory NAME   name of the directory to write playlists to when in browse mode\n"
+		<< "  -p, --problems FILE_NAME      file to record problems with files to, one JSON object per line\n"
+		<< "  -q, --quiet                   only log warnings and errors, and summarize problems\n"
+		<< "  -S, --stats FILE_NAME         file to write a JSON report of timings and counters to\n"
+		<< "  -u, --uring QUEUE_DEPTH       crawl with io_uring, keeping up to QUEUE_DEPTH operations in flight\n"
+		<< "  -V, --verbose                 log every file and playlist, and each problem as it's found\n"
 		<< "  -v, --version                 output version information and exit\n"
+		<< "  -w, --watch DELAY             keep watching for changes, and update playlists DELAY seconds after they stop\n"
 		<< endl;
 }
 
 int main(int argc, char **argv)
 {
+	string statsFileName;
 	int longOptionIndex = 0;
 
 	// Set defaults
 	Track::m_musicLibrary = "INTERNAL";
 
 	// Look at the options
-	int optionChar = getopt_long(argc, argv, "cd:f:hl:m:o:v", g_longOptions, &longOptionIndex);
+	int optionChar = getopt_long(argc, argv, "C:cd:e:f:hJ:j:l:m:o:p:qS:u:Vvw:", g_longOptions, &longOptionIndex);
 	while (optionChar != -1)
 	{
 		switch (optionChar)
 		{
+			case 'C':
+				if (optarg != NULL)
+				{
+					MusicFolderCrawler::m_cacheFileName = optarg;
+				}
+				break;
 			case 'c':
 				MusicFolderCrawler::m_identifyCovers = true;
 				break;
@@ -144,6 +167,12 @@ int main(int argc, char **argv)
 					MusicFolderCrawler::m_maxDepth = (unsigned int)atoi(optarg);
 				}
 				break;
+			case 'e':
+				if (optarg != NULL)
+				{
+					Track::set_audio_extensions(optarg);
+				}
+				break;
 			case 'f':
 				if (optarg != NULL)
 				{
@@ -153,6 +182,19 @@ int main(int argc, char **argv)
 			case 'h':
 				print_help();
 				return EXIT_SUCCESS;
+			case 'J':
+				if (optarg != NULL)
+				{
+					MusicCrawler::m_journalFileName = optarg;
+				}
+				break;
+			case 'j':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					MusicCrawler::m_workersCount = (unsigned int)atoi(optarg);
+				}
+				break;
 			case 'l':
 				if (optarg != NULL)
 				{
@@ -175,15 +217,47 @@ int main(int argc, char **argv)
 					}
 				}
 				break;
+			case 'p':
+				if (optarg != NULL)
+				{
+					Logger::m_problemsFileName = optarg;
+				}
+				break;
+			case 'q':
+				Logger::m_level = LOG_LEVEL_WARNING;
+				break;
+			case 'S':
+				if (optarg != NULL)
+				{
+					statsFileName = optarg;
+				}
+				break;
+			case 'u':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					MusicFolderCrawler::m_uringQueueDepth = (unsigned int)atoi(optarg);
+				}
+				break;
+			case 'V':
+				Logger::m_level = LOG_LEVEL_DEBUG;
+				break;
 			case 'v':
 				clog << PACKAGE_STRING << endl;
 				return EXIT_SUCCESS;
+			case 'w':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					MusicFolderCrawler::m_watchDelay = (unsigned int)atoi(optarg);
+				}
+				break;
 			default:
 				return EXIT_FAILURE;
 		}
 
 		// Next option
-		optionChar = getopt_long(argc, argv, "cd:f:hl:m:o:v", g_longOptions, &longOptionIndex);
+		optionChar = getopt_long(argc, argv, "C:cd:e:f:hJ:j:l:m:o:p:qS:u:Vvw:", g_longOptions, &longOptionIndex);
 	}
 
 	if (argc == 1)
@@ -198,7 +272,27 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	if (parse_items(argv[optind], argv[optind + 1]) == true)
+	if (Logger::start() == false)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (statsFileName.empty() == false)
+	{
+		RunStats::enable();
+	}
+
+	bool parsedItems = parse_items(argv[optind], argv[optind + 1]);
+
+	if ((statsFileName.empty() == false) &&
+		(RunStats::save(statsFileName, "mpbandcamp") == false))
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write stats to " << statsFileName;
+	}
+
+	Logger::stop();
+
+	if (parsedItems == true)
 	{
 		return EXIT_SUCCESS;
 	}
@@ -0,0 +1,622 @@
+/*
+ *  Copyright 2021-2022 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LibraryGenerator.h"
+#include "MusicCrawler.h"
+#include "Track.h"
+#include "Utilities.h"
+
+using std::clog;
+using std::cout;
+using std::endl;
+using std::fixed;
+using std::for_each;
+using std::pair;
+using std::setprecision;
+using std::setw;
+using std::string;
+using std::vector;
+
+static struct option g_longOptions[] = {
+    {"help", 0, 0, 'h'},
+    {"jobs", 1, 0, 'j'},
+    {"scales", 1, 0, 's'},
+    {"version", 0, 0, 'v'},
+    {0, 0, 0, 0}
+};
+
+static size_t g_allocationsCount = 0;
+static size_t g_allocatedSize = 0;
+static size_t g_releasesCount = 0;
+
+// Count allocations made through new, whichever thread makes them
+void *operator new(size_t size)
+{
+	__sync_fetch_and_add(&g_allocationsCount, 1);
+	__sync_fetch_and_add(&g_allocatedSize, size);
+
+	void *pMemory = malloc(size > 0 ? size : 1);
+	if (pMemory == NULL)
+	{
+		throw std::bad_alloc();
+	}
+
+	return pMemory;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *pMemory) noexcept
+{
+	if (pMemory != NULL)
+	{
+		__sync_fetch_and_add(&g_releasesCount, 1);
+	}
+
+	free(pMemory);
+}
+
+void operator delete[](void *pMemory) noexcept
+{
+	operator delete(pMemory);
+}
+
+static double get_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+// Allocations, releases and time, summed over the times it's started and stopped
+class PhaseCounts
+{
+	public:
+		PhaseCounts() :
+			m_allocationsCount(0),
+			m_allocatedSize(0),
+			m_releasesCount(0),
+			m_seconds(0.0),
+			m_startAllocationsCount(0),
+			m_startAllocatedSize(0),
+			m_startReleasesCount(0),
+			m_startTime(0.0)
+		{
+		}
+
+		void start(void)
+		{
+			m_startAllocationsCount = g_allocationsCount;
+			m_startAllocatedSize = g_allocatedSize;
+			m_startReleasesCount = g_releasesCount;
+			m_startTime = get_seconds();
+		}
+
+		void stop(void)
+		{
+			m_seconds += get_seconds() - m_startTime;
+			m_allocationsCount += g_allocationsCount - m_startAllocationsCount;
+			m_allocatedSize += g_allocatedSize - m_startAllocatedSize;
+			m_releasesCount += g_releasesCount - m_startReleasesCount;
+		}
+
+		size_t m_allocationsCount;
+		size_t m_allocatedSize;
+		size_t m_releasesCount;
+		double m_seconds;
+
+	protected:
+		size_t m_startAllocationsCount;
+		size_t m_startAllocatedSize;
+		size_t m_startReleasesCount;
+		double m_startTime;
+
+};
+
+static void report(const string &phase, size_t itemsCount,
+	double seconds, const string &unit = "track")
+{
+	cout << "  " << std::left << setw(16) << phase << std::right
+		<< itemsCount << " " << unit << "(s) in " << fixed << setprecision(3) << seconds << " s, "
+		<< setprecision(0) << (seconds > 0 ? (double)itemsCount / seconds : 0.0) << " " << unit << "s/s";
+}
+
+// Gives the benchmark access to what the crawl found
+class BenchmarkCrawler : public MusicFolderCrawler
+{
+	public:
+		BenchmarkCrawler(const string &topLevelDirName) :
+			MusicFolderCrawler(topLevelDirName)
+		{
+		}
+		virtual ~BenchmarkCrawler()
+		{
+			// Playlists are written by the benchmark, not on the way out
+			clear_playlists();
+		}
+
+		const vector<Track> &get_tracks(void) const
+		{
+			return m_tracks;
+		}
+
+		const ArtistPlaylists &get_artist_playlists(void) const
+		{
+			return m_artistTracks;
+		}
+
+		const Arena &get_arena(void) const
+		{
+			return m_arena;
+		}
+
+	private:
+		BenchmarkCrawler(const BenchmarkCrawler &other);
+		BenchmarkCrawler &operator=(const BenchmarkCrawler &other);
+
+};
+
+static void benchmark_crawl(BenchmarkCrawler &crawler,
+	PhaseCounts &runCounts)
+{
+	PhaseCounts crawlCounts;
+	struct rusage usage;
+
+	crawlCounts.start();
+	runCounts.start();
+
+	crawler.crawl();
+
+	runCounts.stop();
+	crawlCounts.stop();
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	report("crawl", crawler.get_tracks().size(), crawlCounts.m_seconds);
+	cout << ", " << crawlCounts.m_allocationsCount << " allocation(s) of "
+		<< crawlCounts.m_allocatedSize / 1024 << " KB, arena "
+		<< crawler.get_arena().get_used_size() / 1024 << " KB in "
+		<< crawler.get_arena().get_blocks_count() << " block(s), "
+		<< StringPool::get_count() << " interned string(s), max RSS "
+		<< usage.ru_maxrss / 1024 << " MB" << endl;
+}
+
+static void benchmark_tags(const LibraryGenerator &generator,
+	bool scanTags)
+{
+	LogBuffer tagLog;
+	size_t tracksCount = 0, taggedCount = 0;
+	double startTime = get_seconds();
+
+	Track::m_scanTags = scanTags;
+	for (unsigned int artistNum = 0; artistNum < generator.m_artistsCount; ++artistNum)
+	{
+		for (unsigned int albumNum = 0; albumNum < generator.m_albumsCount; ++albumNum)
+		{
+			for (unsigned int trackNum = 0; trackNum < generator.m_tracksCount; ++trackNum)
+			{
+				Track track(generator.get_track_path(artistNum, albumNum, trackNum));
+
+				// Problems aren't of interest here
+				if (track.retrieve_tags(tagLog) == true)
+				{
+					++taggedCount;
+				}
+				tagLog.clear();
+				++tracksCount;
+			}
+		}
+	}
+	Track::m_scanTags = true;
+
+	double seconds = get_seconds() - startTime;
+
+	report(scanTags == true ? "tags (scanner)" : "tags (TagLib)", tracksCount, seconds);
+	cout << ", " << taggedCount << " tagged" << endl;
+}
+
+// How strings were lower cased before fold_case()
+struct LegacyToLowerFunc
+{
+	public:
+		void operator()(char &c)
+		{
+			c = (char)tolower((int)c);
+		}
+};
+
+static string legacy_to_lower_case(const string &str)
+{
+	if (str.empty() == true)
+	{
+		return str;
+	}
+
+	string tmp(str);
+
+	for_each(tmp.begin(), tmp.end(), LegacyToLowerFunc());
+
+	return tmp;
+}
+
+static void benchmark_case(const BenchmarkCrawler &crawler)
+{
+	const vector<Track> &tracks = crawler.get_tracks();
+	vector<string> names, accentedNames;
+	const char *pPhaseNames[] = { "case legacy", "case ASCII", "case fold", "case non-ASCII" };
+
+	// The same keys the crawl makes, as they are and with a non-ASCII letter
+	names.reserve(tracks.size() * 3);
+	accentedNames.reserve(tracks.size() * 3);
+	for (vector<Track>::const_iterator trackIter = tracks.begin();
+		trackIter != tracks.end(); ++trackIter)
+	{
+		names.push_back(trackIter->get_artist());
+		names.push_back(trackIter->get_album());
+		names.push_back(trackIter->get_title());
+	}
+	for (vector<string>::const_iterator nameIter = names.begin();
+		nameIter != names.end(); ++nameIter)
+	{
+		accentedNames.push_back(*nameIter + " \xC3\x89t\xC3\xA9");
+	}
+
+	for (unsigned int phaseNum = 0; phaseNum < 4; ++phaseNum)
+	{
+		const vector<string> &phaseNames = (phaseNum == 3 ? accentedNames : names);
+		size_t keysLength = 0;
+		double startTime = get_seconds();
+
+		for (vector<string>::const_iterator nameIter = phaseNames.begin();
+			nameIter != phaseNames.end(); ++nameIter)
+		{
+			if (phaseNum == 0)
+			{
+				keysLength += legacy_to_lower_case(*nameIter).length();
+			}
+			else if (phaseNum == 1)
+			{
+				keysLength += to_lower_case(*nameIter).length();
+			}
+			else
+			{
+				keysLength += fold_case(*nameIter).length();
+			}
+		}
+
+		// Artist, album and title are folded for each track
+		report(pPhaseNames[phaseNum], phaseNames.size(), get_seconds() - startTime, "string");
+		cout << ", " << keysLength / 1024 << " KB of keys" << endl;
+	}
+}
+
+static void benchmark_sorts(const BenchmarkCrawler &crawler,
+	vector<pair<string, Playlist> > &artistPlaylists,
+	PhaseCounts &runCounts)
+{
+	const vector<Track> &tracks = crawler.get_tracks();
+	TrackSort sorts[] = { TRACK_SORT_ALPHA, TRACK_SORT_YEAR, TRACK_SORT_MTIME };
+	const char *pSortNames[] = { "sort alpha", "sort year", "sort mtime" };
+
+	// The whole library as one playlist
+	for (unsigned int sortNum = 0; sortNum < 3; ++sortNum)
+	{
+		Playlist playlist(sorts[sortNum]);
+
+		playlist.m_trackIndices.reserve(tracks.size());
+		for (unsigned int trackIndex = 0; trackIndex < (unsigned int)tracks.size(); ++trackIndex)
+		{
+			playlist.m_trackIndices.push_back(trackIndex);
+		}
+
+		double startTime = get_seconds();
+
+		playlist.sort_tracks(tracks);
+
+		report(pSortNames[sortNum], tracks.size(), get_seconds() - startTime);
+		cout << endl;
+	}
+
+	// Artist playlists, as they are before being written
+	const ArtistPlaylists &playlists = crawler.get_artist_playlists();
+	size_t tracksCount = 0;
+
+	for (ArtistPlaylists::const_iterator playlistIter = playlists.begin();
+		playlistIter != playlists.end(); ++playlistIter)
+	{
+		if (playlistIter->second.m_trackIndices.empty() == false)
+		{
+			artistPlaylists.push_back(pair<string, Playlist>(clean_file_name(tracks[playlistIter->second.m_trackIndices.front()].get_artist()),
+				playlistIter->second));
+		}
+	}
+
+	PhaseCounts sortCounts;
+
+	// Only this sort is part of an mpgen run
+	sortCounts.start();
+	runCounts.start();
+
+	for (vector<pair<string, Playlist> >::iterator playlistIter = artistPlaylists.begin();
+		playlistIter != artistPlaylists.end(); ++playlistIter)
+	{
+		playlistIter->second.sort_tracks(tracks);
+		tracksCount += playlistIter->second.m_trackIndices.size();
+	}
+
+	runCounts.stop();
+	sortCounts.stop();
+
+	report("sort artists", tracksCount, sortCounts.m_seconds);
+	cout << ", " << artistPlaylists.size() << " playlist(s)" << endl;
+}
+
+static void benchmark_writes(const BenchmarkCrawler &crawler,
+	const vector<pair<string, Playlist> > &artistPlaylists,
+	const string &outputDirectory, PhaseCounts &runCounts)
+{
+	const vector<Track> &tracks = crawler.get_tracks();
+	size_t tracksCount = 0;
+	off_t writtenSize = 0;
+	struct stat fileStat;
+
+	// Write playlists from scratch, not compare them with those of a previous run
+	for (vector<pair<string, Playlist> >::const_iterator playlistIter = artistPlaylists.begin();
+		playlistIter != artistPlaylists.end(); ++playlistIter)
+	{
+		unlink((outputDirectory + playlistIter->first).c_str());
+	}
+
+	PhaseCounts writeCounts;
+
+	writeCounts.start();
+	runCounts.start();
+
+	for (vector<pair<string, Playlist> >::const_iterator playlistIter = artistPlaylists.begin();
+		playlistIter != artistPlaylists.end(); ++playlistIter)
+	{
+		Track::write_file(outputDirectory + playlistIter->first, tracks, playlistIter->second.m_trackIndices);
+		tracksCount += playlistIter->second.m_trackIndices.size();
+	}
+
+	runCounts.stop();
+	writeCounts.stop();
+
+	double seconds = writeCounts.m_seconds;
+
+	for (vector<pair<string, Playlist> >::const_iterator playlistIter = artistPlaylists.begin();
+		playlistIter != artistPlaylists.end(); ++playlistIter)
+	{
+		if (stat((outputDirectory + playlistIter->first).c_str(), &fileStat) == 0)
+		{
+			writtenSize += fileStat.st_size;
+		}
+	}
+
+	report("write", tracksCount, seconds);
+	cout << ", " << writtenSize / 1024 << " KB at " << setprecision(1)
+		<< (seconds > 0 ? (double)writtenSize / (1024 * 1024) / seconds : 0.0) << " MB/s, "
+		<< writeCounts.m_allocationsCount << " allocation(s)" << endl;
+}
+
+static void benchmark_teardown(BenchmarkCrawler *pCrawler,
+	PhaseCounts &runCounts)
+{
+	size_t tracksCount = pCrawler->get_tracks().size();
+	size_t blocksCount = pCrawler->get_arena().get_blocks_count();
+	PhaseCounts teardownCounts;
+
+	// Everything the crawl built goes away with the crawler
+	teardownCounts.start();
+	runCounts.start();
+
+	delete pCrawler;
+
+	runCounts.stop();
+	teardownCounts.stop();
+
+	report("teardown", tracksCount, teardownCounts.m_seconds);
+	cout << ", " << teardownCounts.m_releasesCount << " release(s), arena of "
+		<< blocksCount << " block(s) released in bulk" << endl;
+
+	// Crawl, artist playlists sort, writes and teardown, as mpgen goes through them
+	report("mpgen run", tracksCount, runCounts.m_seconds);
+	cout << ", " << runCounts.m_allocationsCount << " allocation(s) of "
+		<< runCounts.m_allocatedSize / 1024 << " KB, "
+		<< runCounts.m_releasesCount << " release(s)" << endl;
+}
+
+static bool run_benchmark(const string &directoryName, unsigned int scale)
+{
+	// Albums of 10 tracks, 10 albums per artist
+	unsigned int artistsCount = (scale + 99) / 100;
+	char scaleStr[16];
+
+	snprintf(scaleStr, sizeof(scaleStr), "%u", scale);
+
+	string libraryDirName(directoryName + "library-" + scaleStr + "/");
+	string outputDirectory(directoryName + "playlists-" + scaleStr + "/");
+	LibraryGenerator generator(libraryDirName, artistsCount, 10, 10);
+
+	cout << "Scale " << scale << ": " << artistsCount << " artist(s) of 10 album(s) of 10 track(s)" << endl;
+
+	// Libraries are kept for the next run
+	if (access(generator.get_collection_file_name().c_str(), F_OK) != 0)
+	{
+		double startTime = get_seconds();
+
+		if (generator.generate() == false)
+		{
+			return false;
+		}
+
+		report("generate", (size_t)artistsCount * 100, get_seconds() - startTime);
+		cout << endl;
+	}
+
+	if ((mkdir(outputDirectory.c_str(), 0755) != 0) &&
+		(errno != EEXIST))
+	{
+		clog << "Couldn't create " << outputDirectory << endl;
+		return false;
+	}
+
+	PhaseCounts runCounts;
+
+	Track::m_fromPath = libraryDirName;
+	MusicCrawler::m_outputDirectory = outputDirectory;
+
+	runCounts.start();
+	BenchmarkCrawler *pCrawler = new BenchmarkCrawler(libraryDirName);
+	runCounts.stop();
+
+	vector<pair<string, Playlist> > artistPlaylists;
+
+	benchmark_crawl(*pCrawler, runCounts);
+	benchmark_tags(generator, true);
+	benchmark_tags(generator, false);
+	benchmark_case(*pCrawler);
+	benchmark_sorts(*pCrawler, artistPlaylists, runCounts);
+	benchmark_writes(*pCrawler, artistPlaylists, outputDirectory, runCounts);
+
+	// The benchmark's copies of artist playlists aren't part of the crawler's teardown
+	vector<pair<string, Playlist> >().swap(artistPlaylists);
+	benchmark_teardown(pCrawler, runCounts);
+
+	return true;
+}
+
+static void print_help(void)
+{
+	clog << "mpbench - mpgen benchmark\n\n"
+		<< "Usage: mpbench [OPTIONS] DIRECTORY\n\n"
+		<< "Options:\n"
+		<< "  -h, --help                    display this help and exit\n"
+		<< "  -j, --jobs NUM                number of threads to crawl with, defaults to 1\n"
+		<< "  -s, --scales LIST             comma separated list of library sizes in tracks, defaults to 10000,100000,1000000\n"
+		<< "  -v, --version                 output version information and exit\n"
+		<< endl;
+}
+
+int main(int argc, char **argv)
+{
+	int longOptionIndex = 0;
+	string scales("10000,100000,1000000");
+
+	// Set defaults
+	Track::m_musicLibrary = "INTERNAL";
+
+	// Look at the options
+	int optionChar = getopt_long(argc, argv, "hj:s:v", g_longOptions, &longOptionIndex);
+	while (optionChar != -1)
+	{
+		switch (optionChar)
+		{
+			case 'h':
+				print_help();
+				return EXIT_SUCCESS;
+			case 'j':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					MusicCrawler::m_workersCount = (unsigned int)atoi(optarg);
+				}
+				break;
+			case 's':
+				if (optarg != NULL)
+				{
+					scales = optarg;
+				}
+				break;
+			case 'v':
+				clog << PACKAGE_STRING << endl;
+				return EXIT_SUCCESS;
+			default:
+				return EXIT_FAILURE;
+		}
+
+		// Next option
+		optionChar = getopt_long(argc, argv, "hj:s:v", g_longOptions, &longOptionIndex);
+	}
+
+	if (argc - optind != 1)
+	{
+		clog << "Wrong number of parameters, expected DIRECTORY" << endl;
+		return EXIT_FAILURE;
+	}
+
+	string directoryName(argv[optind]);
+
+	if (directoryName[directoryName.length() - 1] != '/')
+	{
+		directoryName += "/";
+	}
+
+	if ((mkdir(directoryName.c_str(), 0755) != 0) &&
+		(errno != EEXIST))
+	{
+		clog << "Couldn't create " << directoryName << endl;
+		return EXIT_FAILURE;
+	}
+
+	// Libraries are created in DIRECTORY, smallest first
+	string::size_type startPos = 0;
+	while (startPos <= scales.length())
+	{
+		string::size_type endPos = scales.find(',', startPos);
+
+		if (endPos == string::npos)
+		{
+			endPos = scales.length();
+		}
+
+		int scale = atoi(scales.substr(startPos, endPos - startPos).c_str());
+
+		if ((scale > 0) &&
+			(run_benchmark(directoryName, (unsigned int)scale) == false))
+		{
+			return EXIT_FAILURE;
+		}
+
+		startPos = endPos + 1;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -17,188 +17,587 @@
  */
 
 #include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <getopt.h>
+#include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <utility>
 
+#include "Logger.h"
+#include "PlaylistScanner.h"
+#include "RunStats.h"
 #include "Track.h"
 #include "Utilities.h"
+#include "WorkerPool.h"
 
 using std::clog;
 using std::endl;
-using std::stringstream;
+using std::ifstream;
+using std::map;
+using std::move;
+using std::set;
+using std::sort;
 using std::string;
+using std::stringstream;
 using std::vector;
 
 static struct option g_longOptions[] = {
+    {"batch", 0, 0, 'b'},
     {"from", 1, 0, 'f'},
     {"help", 0, 0, 'h'},
+    {"jobs", 1, 0, 'j'},
     {"music-library", 1, 0, 'm'},
+    {"problems", 1, 0, 'p'},
+    {"quiet", 0, 0, 'q'},
+    {"stats", 1, 0, 'S'},
     {"sort", 1, 0, 's'},
     {"to", 1, 0, 't'},
+    {"verbose", 0, 0, 'V'},
     {"version", 0, 0, 'v'},
     {0, 0, 0, 0}
 };
 
-static bool convert_playlist(const string &inputFileName,
-	const string &sortBy,
-	const string &outputFileName)
+// Remembers the tags of every track looked at, so that each file is only read once per run
+class TrackMemo
 {
-	if ((inputFileName.empty() == true) ||
-		(outputFileName.empty() == true))
+	public:
+		TrackMemo()
+		{
+			pthread_mutex_init(&m_mutex, NULL);
+			pthread_cond_init(&m_doneCond, NULL);
+		}
+		~TrackMemo()
+		{
+			for (map<string, MemoEntry*>::iterator entryIter = m_entries.begin();
+				entryIter != m_entries.end(); ++entryIter)
+			{
+				delete entryIter->second;
+			}
+
+			pthread_cond_destroy(&m_doneCond);
+			pthread_mutex_destroy(&m_mutex);
+		}
+
+		bool retrieve_tags(Track &track, const string &trackPath,
+			LogBuffer &logBuffer)
+		{
+			pthread_mutex_lock(&m_mutex);
+
+			map<string, MemoEntry*>::iterator entryIter = m_entries.find(trackPath);
+			if (entryIter != m_entries.end())
+			{
+				MemoEntry *pEntry = entryIter->second;
+
+				// Another playlist may be reading this track right now
+				while (pEntry->m_done == false)
+				{
+					pthread_cond_wait(&m_doneCond, &m_mutex);
+				}
+
+				track = pEntry->m_track;
+				logBuffer.append(pEntry->m_log);
+
+				pthread_mutex_unlock(&m_mutex);
+
+				return pEntry->m_found;
+			}
+
+			MemoEntry *pEntry = new MemoEntry(track);
+
+			m_entries[trackPath] = pEntry;
+
+			pthread_mutex_unlock(&m_mutex);
+
+			// Read tags without holding the lock
+			LogBuffer trackLog;
+			PhaseTimer tagTimer("tags");
+			bool found = track.retrieve_tags(trackLog);
+
+			RunStats::add_file(trackPath, tagTimer.stop());
+			RunStats::add_count(found == true ? "files_tagged" : "files_rejected");
+
+			logBuffer.append(trackLog);
+
+			pthread_mutex_lock(&m_mutex);
+
+			pEntry->m_track = track;
+			pEntry->m_log = trackLog;
+			pEntry->m_found = found;
+			pEntry->m_done = true;
+			pthread_cond_broadcast(&m_doneCond);
+
+			pthread_mutex_unlock(&m_mutex);
+
+			return found;
+		}
+
+	protected:
+		struct MemoEntry
+		{
+			MemoEntry(const Track &track) :
+				m_track(track),
+				m_found(false),
+				m_done(false)
+			{
+			}
+
+			Track m_track;
+			LogBuffer m_log;
+			bool m_found;
+			bool m_done;
+		};
+
+		map<string, MemoEntry*> m_entries;
+		pthread_mutex_t m_mutex;
+		pthread_cond_t m_doneCond;
+
+	private:
+		TrackMemo(const TrackMemo &other);
+		TrackMemo &operator=(const TrackMemo &other);
+
+};
+
+// Looks up the tags of one playlist entry, possibly on a worker thread
+class LookupJob : public WorkerJob
+{
+	public:
+		LookupJob(const string &trackPath,
+			const string &trackName,
+			TrackMemo &memo) :
+			WorkerJob(),
+			m_track(trackPath),
+			m_trackPath(trackPath),
+			m_trackName(trackName),
+			m_memo(memo),
+			m_found(false)
+		{
+		}
+		virtual ~LookupJob()
+		{
+		}
+
+		virtual void run(void)
+		{
+			if (m_trackName.empty() == false)
+			{
+				m_log.log(LOG_LEVEL_DEBUG, "Track name " + m_trackName);
+			}
+
+			m_track.adjust_path();
+			m_found = m_memo.retrieve_tags(m_track, m_trackPath, m_log);
+		}
+
+		Track m_track;
+		string m_trackPath;
+		string m_trackName;
+		TrackMemo &m_memo;
+		LogBuffer m_log;
+		bool m_found;
+
+};
+
+static void add_track(LookupJob *pJob, TrackSort sort,
+	LogBuffer &logBuffer, vector<Track> &tracks)
+{
+	logBuffer.append(pJob->m_log);
+
+	if (pJob->m_found == true)
 	{
-		return false;
+		pJob->m_track.set_sort(sort);
+
+		// The job is deleted right after
+		tracks.push_back(move(pJob->m_track));
 	}
 
-	off_t length = 0;
+	delete pJob;
+}
 
-	clog << "Opening " << inputFileName << endl;
+static void add_tracks(WorkerPool *pLookups, unsigned int maxJobsCount,
+	TrackSort sort, LogBuffer &logBuffer, vector<Track> &tracks)
+{
+	WorkerJob *pJob = pLookups->pop_job(pLookups->get_jobs_count() > maxJobsCount);
+	while (pJob != NULL)
+	{
+		add_track(dynamic_cast<LookupJob*>(pJob), sort, logBuffer, tracks);
 
-	// Slurp the whole file
-	char *pPlaylist = load_file(inputFileName, length);
+		pJob = pLookups->pop_job(pLookups->get_jobs_count() > maxJobsCount);
+	}
+}
 
-	if (pPlaylist == NULL)
+static bool convert_playlist(const string &inputFileName,
+	TrackSort sort, TrackMemo &memo, unsigned int workersCount,
+	LogBuffer &logBuffer, vector<Track> &tracks)
+{
+	if (inputFileName.empty() == true)
 	{
 		return false;
 	}
 
-	if (length == 0)
-	{
-		delete[] pPlaylist;
+	logBuffer.log(LOG_LEVEL_INFO, "Opening " + inputFileName);
 
+	// Map the whole file
+	MappedFile playlistFile(inputFileName);
+
+	if ((playlistFile.is_open() == false) ||
+		(playlistFile.get_length() == 0))
+	{
 		return false;
 	}
+	RunStats::add_count("bytes_read", (unsigned long long)playlistFile.get_length());
 
-	string playlist(pPlaylist, length);
-	string::size_type startPos = playlist.find('\r');
-	unsigned int replaceCount = 0;
+	// What the scanner reports goes before the log of the entry that follows
+	LogBuffer scanLog;
+	PlaylistScanner scanner(playlistFile.get_data(), playlistFile.get_length(), scanLog);
+	WorkerPool *pLookups = NULL;
+	string trackPath, trackName;
+
+	// Check for a header
+	if (scanner.read_header() == false)
+	{
+		logBuffer.append(scanLog);
+		return false;
+	}
 
-	delete[] pPlaylist;
+	if (workersCount > 1)
+	{
+		pLookups = new WorkerPool(workersCount);
+	}
 
-	// Replace \r with \n in place
-    while (startPos != string::npos)
+	// Go through the M3U8 file one track at a time, and put tracks back in the same order
+	while (scanner.next_track(trackPath, trackName) == true)
 	{
-		playlist.replace(startPos, 1, "\n");
-		++replaceCount;
+		LookupJob *pJob = new LookupJob(trackPath, trackName, memo);
 
-		if (startPos + 1 >= playlist.length())
+		RunStats::add_count("files_seen");
+
+		pJob->m_log.append(scanLog);
+		scanLog.clear();
+
+		if (pLookups != NULL)
 		{
-			break;
+			// Keep enough lookups in flight to hide latency
+			add_tracks(pLookups, workersCount * 4, sort, logBuffer, tracks);
+
+			if (pLookups->push_job(pJob) == true)
+			{
+				continue;
+			}
+
+			add_tracks(pLookups, 0, sort, logBuffer, tracks);
 		}
-    	startPos = playlist.find('\r', startPos + 1);
+
+		pJob->run();
+
+		add_track(pJob, sort, logBuffer, tracks);
 	}
 
-	stringstream inputFile(playlist);
+	if (pLookups != NULL)
+	{
+		add_tracks(pLookups, 0, sort, logBuffer, tracks);
+
+		delete pLookups;
+	}
+	logBuffer.append(scanLog);
+
+	stringstream foundStr;
+	foundStr << "Found " << tracks.size() << " tracks";
+	logBuffer.log(LOG_LEVEL_INFO, foundStr.str());
+	RunStats::add_count("tracks", tracks.size());
 
-	if (inputFile.good() == false)
+	if (tracks.empty() == true)
 	{
 		return false;
 	}
 
-	vector<Track> tracks;
-	string line, trackName;
-	bool firstLine = true, getTrackPath = false;
-	unsigned int lineCount = 1;
+	return true;
+}
 
-	// Parse the M3U8 file
-	while (getline(inputFile, line).eof() == false)
-	{
-		// Check for a header
-		if (firstLine == true)
+class ConvertJob : public WorkerJob
+{
+	public:
+		ConvertJob(const string &inputFileName,
+			const string &outputFileName,
+			TrackSort sort, TrackMemo &memo) :
+			WorkerJob(),
+			m_inputFileName(inputFileName),
+			m_outputFileName(outputFileName),
+			m_sort(sort),
+			m_memo(memo),
+			m_converted(false)
+		{
+		}
+		virtual ~ConvertJob()
 		{
-			firstLine = false;
+		}
 
-			string::size_type startPos = line.find("#EXTM3U");
+		virtual void run(void)
+		{
+			vector<Track> tracks;
 
-			if ((startPos == string::npos) ||
-				(startPos != 0))
+			// Playlists are converted concurrently already, look up their tracks one at a time
+			m_converted = convert_playlist(m_inputFileName, m_sort, m_memo, 1,
+				m_log, tracks);
+			if (m_converted == true)
 			{
-				clog << "Expected #EXTM3U at line 1, found " << line.substr(0, 7) << endl;
-				return false;
+				PhaseTimer renderTimer("render");
+
+				Track::render_playlist(tracks, m_content);
 			}
-			continue;
 		}
 
-		string::size_type trackDataPos = line.find("#EXTINF:");
+		string m_inputFileName;
+		string m_outputFileName;
+		TrackSort m_sort;
+		TrackMemo &m_memo;
+		LogBuffer m_log;
+		bool m_converted;
+		string m_content;
+
+};
+
+static bool is_playlist_name(const string &fileName)
+{
+	string lowerName(to_lower_case(fileName));
+
+	if (((lowerName.length() > 5) &&
+		(lowerName.compare(lowerName.length() - 5, 5, ".m3u8") == 0)) ||
+		((lowerName.length() > 4) &&
+		(lowerName.compare(lowerName.length() - 4, 4, ".m3u") == 0)))
+	{
+		return true;
+	}
+
+	return false;
+}
+
+static bool list_playlists(const string &dirOrListName,
+	vector<string> &inputFileNames)
+{
+	struct stat listStat;
+
+	if (stat(dirOrListName.c_str(), &listStat) != 0)
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to open " << dirOrListName;
+		return false;
+	}
+
+	if (S_ISDIR(listStat.st_mode))
+	{
+		DIR *pDir = opendir(dirOrListName.c_str());
+
+		if (pDir == NULL)
+		{
+			LogMessage(LOG_LEVEL_ERROR) << "Failed to open " << dirOrListName;
+			return false;
+		}
+
+		string dirName(dirOrListName);
+
+		if (dirName[dirName.length() - 1] != '/')
+		{
+			dirName += "/";
+		}
 
-		// Check validity of info lines
-		if ((trackDataPos != string::npos) &&
-			(trackDataPos == 0))
+		// Pick all M3U8 playlists in the directory
+		struct dirent *pDirEntry = readdir(pDir);
+		while (pDirEntry != NULL)
 		{
-			string::size_type trackNamePos = line.find(",", trackDataPos);
+			string entryName(pDirEntry->d_name);
 
-			if ((trackNamePos == string::npos) ||
-				(trackNamePos + 1 >= line.length()))
+			if ((entryName[0] != '.') &&
+				(is_playlist_name(entryName) == true))
 			{
-				clog << "Expected comma at line " << lineCount << endl;
-				return false;
+				inputFileNames.push_back(dirName + entryName);
 			}
-			trackName = line.substr(trackNamePos + 1);
 
-			clog << "Track name " << trackName << endl;
+			pDirEntry = readdir(pDir);
+		}
+
+		closedir(pDir);
 
-			getTrackPath = true;
+		// The order the directory is read in isn't meaningful
+		sort(inputFileNames.begin(), inputFileNames.end());
+	}
+	else
+	{
+		ifstream listFile;
+
+		listFile.open(dirOrListName.c_str());
+		if (listFile.good() == false)
+		{
+			LogMessage(LOG_LEVEL_ERROR) << "Failed to open " << dirOrListName;
+			return false;
 		}
-		// Every second line should be a track path
-		else if (getTrackPath == true)
+
+		// One playlist per line
+		string line;
+		while (getline(listFile, line))
 		{
-			Track newTrack(line);
+			if ((line.empty() == false) &&
+				(line[line.length() - 1] == '\r'))
+			{
+				line.resize(line.length() - 1);
+			}
 
-			newTrack.adjust_path();
-			if (newTrack.retrieve_tags() == true)
+			if ((line.empty() == false) &&
+				(line[0] != '#'))
 			{
-				TrackSort sort = TRACK_SORT_ALPHA;
+				inputFileNames.push_back(line);
+			}
+		}
+	}
 
-				if (sortBy == "year")
-				{
-					sort = TRACK_SORT_YEAR;
-				}
-				else if (sortBy == "mtime")
+	return true;
+}
+
+static string get_output_file_name(const string &outputDirectory,
+	const string &inputFileName)
+{
+	string baseName(inputFileName);
+	string::size_type pos = baseName.find_last_of('/');
+
+	if (pos != string::npos)
+	{
+		baseName.erase(0, pos + 1);
+	}
+
+	// MPD playlists don't have an extension
+	pos = baseName.find_last_of('.');
+	if ((pos != string::npos) &&
+		(pos > 0))
+	{
+		baseName.resize(pos);
+	}
+
+	return outputDirectory + baseName;
+}
+
+static bool write_converted_playlist(ConvertJob *pJob)
+{
+	bool converted = pJob->m_converted;
+
+	Logger::flush(pJob->m_log);
+
+	if (converted == true)
+	{
+		Track::write_file(pJob->m_outputFileName, pJob->m_content);
+	}
+
+	delete pJob;
+
+	return converted;
+}
+
+static bool convert_playlists(const string &dirOrListName,
+	const string &outputDirectory,
+	TrackSort sort, unsigned int workersCount)
+{
+	vector<string> inputFileNames;
+	set<string> outputFileNames;
+	TrackMemo memo;
+	WorkerPool *pWorkers = NULL;
+	bool allConverted = true;
+
+	if (list_playlists(dirOrListName, inputFileNames) == false)
+	{
+		return false;
+	}
+
+	if (workersCount > 1)
+	{
+		pWorkers = new WorkerPool(workersCount);
+	}
+
+	for (vector<string>::const_iterator nameIter = inputFileNames.begin();
+		nameIter != inputFileNames.end(); ++nameIter)
+	{
+		string outputFileName(get_output_file_name(outputDirectory, *nameIter));
+
+		if (outputFileNames.insert(outputFileName).second == false)
+		{
+			LogMessage(LOG_LEVEL_WARNING) << "Skipping " << *nameIter << ", " << outputFileName << " is written already";
+			allConverted = false;
+			continue;
+		}
+
+		ConvertJob *pJob = new ConvertJob(*nameIter, outputFileName, sort, memo);
+
+		if (pWorkers != NULL)
+		{
+			// Write playlists in order as they are converted
+			WorkerJob *pDoneJob = pWorkers->pop_job(pWorkers->get_jobs_count() > workersCount * 2);
+			while (pDoneJob != NULL)
+			{
+				if (write_converted_playlist(dynamic_cast<ConvertJob*>(pDoneJob)) == false)
 				{
-					sort = TRACK_SORT_MTIME;
+					allConverted = false;
 				}
-				newTrack.set_sort(sort);
 
-				tracks.push_back(newTrack);
+				pDoneJob = pWorkers->pop_job(pWorkers->get_jobs_count() > workersCount * 2);
 			}
 
-			trackName.clear();
-			getTrackPath = false;
+			if (pWorkers->push_job(pJob) == true)
+			{
+				continue;
+			}
 		}
-		else
+
+		pJob->run();
+
+		if (write_converted_playlist(pJob) == false)
 		{
-			clog << "Expected #EXTINF at line " << lineCount << endl;
-			break;
+			allConverted = false;
 		}
-
-		++lineCount;
 	}
 
-	clog << "Found " << tracks.size() << " tracks" << endl;
-
-	if (tracks.empty() == true)
+	if (pWorkers != NULL)
 	{
-		return false;
+		WorkerJob *pDoneJob = pWorkers->pop_job(pWorkers->get_jobs_count() > 0);
+		while (pDoneJob != NULL)
+		{
+			if (write_converted_playlist(dynamic_cast<ConvertJob*>(pDoneJob)) == false)
+			{
+				allConverted = false;
+			}
+
+			pDoneJob = pWorkers->pop_job(pWorkers->get_jobs_count() > 0);
+		}
+
+		delete pWorkers;
 	}
 
-	Track::write_file(outputFileName, tracks);
+	LogMessage(LOG_LEVEL_INFO) << "Converted " << inputFileNames.size() << " playlist(s), wrote "
+		<< Track::m_writtenFilesCount << ", " << Track::m_unchangedFilesCount << " were unchanged";
 
-	return true;
+	return allConverted;
 }
 
 static void print_help(void)
 {
 	clog << "mpconv - M3U8 to mpd playlist converter\n\n"
-		<< "Usage: mpconv [OPTIONS] M3U8_PLAYLIST MPD_PLAYLIST\n\n"
+		<< "Usage: mpconv [OPTIONS] M3U8_PLAYLIST MPD_PLAYLIST\n"
+		<< "       mpconv [OPTIONS] --batch M3U8_DIRECTORY|LIST_FILE_NAME MPD_DIRECTORY\n\n"
 		<< "Options:\n"
+		<< "  -b, --batch                   convert all playlists in a directory, or listed in a file\n"
 		<< "  -f, --from EXISTING_PATH      path to replace\n"
 		<< "  -h, --help                    display this help and exit\n"
+		<< "  -j, --jobs NUM                number of tracks to look up at once, or of playlists in batch mode, defaults to 1\n"
 		<< "  -m, --music-library NAME      name of the music library this is for, defaults to INTERNAL\n"
+		<< "  -p, --problems FILE_NAME      file to record problems with files to, one JSON object per line\n"
+		<< "  -q, --quiet                   only log warnings and errors, and summarize problems\n"
+		<< "  -S, --stats FILE_NAME         file to write a JSON report of timings and counters to\n"
 		<< "  -s, --sort alpha|year|mtime   how to sort MPD_PLAYLIST\n"
 		<< "  -t, --to NEW_PATH             path to replace EXISTING_PATH with\n"
+		<< "  -V, --verbose                 log every file and playlist, and each problem as it's found\n"
 		<< "  -v, --version                 output version information and exit\n"
 		<< endl;
 }
@@ -206,17 +605,23 @@ static void print_help(void)
 int main(int argc, char **argv)
 {
 	string sortBy;
+	string statsFileName;
+	unsigned int workersCount = 1;
 	int longOptionIndex = 0;
+	bool batchMode = false;
 
 	// Set defaults
 	Track::m_musicLibrary = "INTERNAL";
 
 	// Look at the options
-	int optionChar = getopt_long(argc, argv, "f:hm:s:t:v", g_longOptions, &longOptionIndex);
+	int optionChar = getopt_long(argc, argv, "bf:hj:m:p:qS:s:t:Vv", g_longOptions, &longOptionIndex);
 	while (optionChar != -1)
 	{
 		switch (optionChar)
 		{
+			case 'b':
+				batchMode = true;
+				break;
 			case 'f':
 				if (optarg != NULL)
 				{
@@ -226,12 +631,34 @@ int main(int argc, char **argv)
 			case 'h':
 				print_help();
 				return EXIT_SUCCESS;
+			case 'j':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					workersCount = (unsigned int)atoi(optarg);
+				}
+				break;
 			case 'm':
 				if (optarg != NULL)
 				{
 					Track::m_musicLibrary = optarg;
 				}
 				break;
+			case 'p':
+				if (optarg != NULL)
+				{
+					Logger::m_problemsFileName = optarg;
+				}
+				break;
+			case 'q':
+				Logger::m_level = LOG_LEVEL_WARNING;
+				break;
+			case 'S':
+				if (optarg != NULL)
+				{
+					statsFileName = optarg;
+				}
+				break;
 			case 's':
 				if (optarg != NULL)
 				{
@@ -244,6 +671,9 @@ int main(int argc, char **argv)
 					Track::m_toPath = optarg;
 				}
 				break;
+			case 'V':
+				Logger::m_level = LOG_LEVEL_DEBUG;
+				break;
 			case 'v':
 				clog << PACKAGE_STRING << endl;
 				return EXIT_SUCCESS;
@@ -252,7 +682,7 @@ int main(int argc, char **argv)
 		}
 
 		// Next option
-		optionChar = getopt_long(argc, argv, "f:hm:s:t:v", g_longOptions, &longOptionIndex);
+		optionChar = getopt_long(argc, argv, "bf:hj:m:p:qS:s:t:Vv", g_longOptions, &longOptionIndex);
 	}
 
 	if (argc == 1)
@@ -263,11 +693,76 @@ int main(int argc, char **argv)
 
 	if (argc - optind != 2)
 	{
-		clog << "Wrong number of parameters, expected M3U8_PLAYLIST and MPD_PLAYLIST" << endl;
+		if (batchMode == true)
+		{
+			clog << "Wrong number of parameters, expected M3U8_DIRECTORY|LIST_FILE_NAME and MPD_DIRECTORY" << endl;
+		}
+		else
+		{
+			clog << "Wrong number of parameters, expected M3U8_PLAYLIST and MPD_PLAYLIST" << endl;
+		}
 		return EXIT_FAILURE;
 	}
 
-	if (convert_playlist(argv[optind], sortBy, argv[optind + 1]) == true)
+	TrackSort sort = TRACK_SORT_ALPHA;
+
+	if (sortBy == "year")
+	{
+		sort = TRACK_SORT_YEAR;
+	}
+	else if (sortBy == "mtime")
+	{
+		sort = TRACK_SORT_MTIME;
+	}
+
+	if (Logger::start() == false)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (statsFileName.empty() == false)
+	{
+		RunStats::enable();
+	}
+
+	bool converted = false;
+
+	if (batchMode == true)
+	{
+		string outputDirectory(argv[optind + 1]);
+
+		if (outputDirectory[outputDirectory.length() - 1] != '/')
+		{
+			outputDirectory += "/";
+		}
+
+		converted = convert_playlists(argv[optind], outputDirectory, sort, workersCount);
+	}
+	else
+	{
+		string outputFileName(argv[optind + 1]);
+		TrackMemo memo;
+		LogBuffer logBuffer(true);
+		vector<Track> tracks;
+
+		if ((outputFileName.empty() == false) &&
+			(convert_playlist(argv[optind], sort, memo, workersCount, logBuffer, tracks) == true))
+		{
+			Track::write_file(outputFileName, tracks);
+
+			converted = true;
+		}
+	}
+
+	if ((statsFileName.empty() == false) &&
+		(RunStats::save(statsFileName, "mpconv") == false))
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write stats to " << statsFileName;
+	}
+
+	Logger::stop();
+
+	if (converted == true)
 	{
 		return EXIT_SUCCESS;
 	}
@@ -24,7 +24,9 @@
 #include <vector>
 #include <utility>
 
+#include "Logger.h"
 #include "MusicCrawler.h"
+#include "RunStats.h"
 #include "Track.h"
 #include "Utilities.h"
 
@@ -35,13 +37,23 @@ using std::string;
 using std::vector;
 
 static struct option g_longOptions[] = {
+    {"cache", 1, 0, 'C'},
     {"covers", 0, 0, 'c'},
     {"max-depth", 0, 0, 'd'},
+    {"extensions", 1, 0, 'e'},
     {"from", 1, 0, 'f'},
     {"help", 0, 0, 'h'},
+    {"journal", 1, 0, 'J'},
+    {"jobs", 1, 0, 'j'},
     {"music-library", 1, 0, 'm'},
     {"output-directory", 1, 0, 'o'},
+    {"problems", 1, 0, 'p'},
+    {"quiet", 0, 0, 'q'},
+    {"stats", 1, 0, 'S'},
+    {"uring", 1, 0, 'u'},
+    {"verbose", 0, 0, 'V'},
     {"version", 0, 0, 'v'},
+    {"watch", 1, 0, 'w'},
     {0, 0, 0, 0}
 };
 
@@ -56,6 +68,11 @@ static void crawl_collection(const string &topLevelDirName)
 	}
 
 	crawler.crawl();
+
+	if (MusicFolderCrawler::m_watchDelay > 0)
+	{
+		crawler.watch();
+	}
 }
 
 static void print_help(void)
@@ -63,29 +80,46 @@ static void print_help(void)
 	clog << "mpgen - mpd playlists generator\n\n"
 		<< "Usage: mpgen [OPTIONS] MUSIC_DIRECTORY\n\n"
 		<< "Options:\n"
+		<< "  -C, --cache FILE_NAME         file to cache tags in between runs\n"
 		<< "  -c, --covers                  try and identify covers\n"
 		<< "  -d, --max-depth               maximum depth when in browse mode\n"
+		<< "  -e, --extensions LIST         comma separated list of extensions of files to read tags from\n"
 		<< "  -f, --from EXISTING_PATH      path to replace\n"
 		<< "  -h, --help                    display this help and exit\n"
+		<< "  -J, --journal FILE_NAME       file to record playlists in, so that unchanged ones aren't written again\n"
+		<< "  -j, --jobs NUM                number of threads to read tags and sort playlists with, defaults to 1\n"
 		<< "  -m, --music-library NAME      name of the music library this is for, defaults to INTERNAL\n"
 		<< "  -o, --output-directory NAME   name of the directory to write playlists to when in browse mode\n"
+		<< "  -p, --problems FILE_NAME      file to record problems with files to, one JSON object per line\n"
+		<< "  -q, --quiet                   only log warnings and errors, and summarize problems\n"
+		<< "  -S, --stats FILE_NAME         file to write a JSON report of timings and counters to\n"
+		<< "  -u, --uring QUEUE_DEPTH       crawl with io_uring, keeping up to QUEUE_DEPTH operations in flight\n"
+		<< "  -V, --verbose                 log every file and playlist, and each problem as it's found\n"
 		<< "  -v, --version                 output version information and exit\n"
+		<< "  -w, --watch DELAY             keep watching for changes, and update playlists DELAY seconds after they stop\n"
 		<< endl;
 }
 
 int main(int argc, char **argv)
 {
+	string statsFileName;
 	int longOptionIndex = 0;
 
 	// Set defaults
 	Track::m_musicLibrary = "INTERNAL";
 
 	// Look at the options
-	int optionChar = getopt_long(argc, argv, "cd:f:hm:o:v", g_longOptions, &longOptionIndex);
+	int optionChar = getopt_long(argc, argv, "C:cd:e:f:hJ:j:m:o:p:qS:u:Vvw:", g_longOptions, &longOptionIndex);
 	while (optionChar != -1)
 	{
 		switch (optionChar)
 		{
+			case 'C':
+				if (optarg != NULL)
+				{
+					MusicFolderCrawler::m_cacheFileName = optarg;
+				}
+				break;
 			case 'c':
 				MusicFolderCrawler::m_identifyCovers = true;
 				break;
@@ -95,6 +129,12 @@ int main(int argc, char **argv)
 					MusicFolderCrawler::m_maxDepth = (unsigned int)atoi(optarg);
 				}
 				break;
+			case 'e':
+				if (optarg != NULL)
+				{
+					Track::set_audio_extensions(optarg);
+				}
+				break;
 			case 'f':
 				if (optarg != NULL)
 				{
@@ -104,6 +144,19 @@ int main(int argc, char **argv)
 			case 'h':
 				print_help();
 				return EXIT_SUCCESS;
+			case 'J':
+				if (optarg != NULL)
+				{
+					MusicCrawler::m_journalFileName = optarg;
+				}
+				break;
+			case 'j':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					MusicCrawler::m_workersCount = (unsigned int)atoi(optarg);
+				}
+				break;
 			case 'm':
 				if (optarg != NULL)
 				{
@@ -120,15 +173,47 @@ int main(int argc, char **argv)
 					}
 				}
 				break;
+			case 'p':
+				if (optarg != NULL)
+				{
+					Logger::m_problemsFileName = optarg;
+				}
+				break;
+			case 'q':
+				Logger::m_level = LOG_LEVEL_WARNING;
+				break;
+			case 'S':
+				if (optarg != NULL)
+				{
+					statsFileName = optarg;
+				}
+				break;
+			case 'u':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					MusicFolderCrawler::m_uringQueueDepth = (unsigned int)atoi(optarg);
+				}
+				break;
+			case 'V':
+				Logger::m_level = LOG_LEVEL_DEBUG;
+				break;
 			case 'v':
 				clog << PACKAGE_STRING << endl;
 				return EXIT_SUCCESS;
+			case 'w':
+				if ((optarg != NULL) &&
+					(atoi(optarg) > 0))
+				{
+					MusicFolderCrawler::m_watchDelay = (unsigned int)atoi(optarg);
+				}
+				break;
 			default:
 				return EXIT_FAILURE;
 		}
 
 		// Next option
-		optionChar = getopt_long(argc, argv, "cd:f:hm:o:v", g_longOptions, &longOptionIndex);
+		optionChar = getopt_long(argc, argv, "C:cd:e:f:hJ:j:m:o:p:qS:u:Vvw:", g_longOptions, &longOptionIndex);
 	}
 
 	if (argc == 1)
@@ -143,8 +228,26 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	if (Logger::start() == false)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (statsFileName.empty() == false)
+	{
+		RunStats::enable();
+	}
+
 	crawl_collection(argv[optind]);
 
+	if ((statsFileName.empty() == false) &&
+		(RunStats::save(statsFileName, "mpgen") == false))
+	{
+		LogMessage(LOG_LEVEL_ERROR) << "Failed to write stats to " << statsFileName;
+	}
+
+	Logger::stop();
+
 	return EXIT_SUCCESS;
 }
 
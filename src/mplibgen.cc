@@ -0,0 +1,108 @@
+/*
+ *  Copyright 2021-2022 Fabrice Colin
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <stdlib.h>
+#include <getopt.h>
+#include <iostream>
+#include <string>
+
+#include "LibraryGenerator.h"
+
+using std::clog;
+using std::endl;
+using std::string;
+
+static struct option g_longOptions[] = {
+    {"artists", 1, 0, 'a'},
+    {"albums", 1, 0, 'b'},
+    {"help", 0, 0, 'h'},
+    {"tracks", 1, 0, 't'},
+    {"version", 0, 0, 'v'},
+    {0, 0, 0, 0}
+};
+
+static void print_help(void)
+{
+	clog << "mplibgen - synthetic music library generator\n\n"
+		<< "Usage: mplibgen [OPTIONS] DIRECTORY\n\n"
+		<< "Options:\n"
+		<< "  -a, --artists NUM             number of artists, defaults to 10\n"
+		<< "  -b, --albums NUM              number of albums per artist, defaults to 10\n"
+		<< "  -h, --help                    display this help and exit\n"
+		<< "  -t, --tracks NUM              number of tracks per album, defaults to 10\n"
+		<< "  -v, --version                 output version information and exit\n"
+		<< endl;
+}
+
+int main(int argc, char **argv)
+{
+	int longOptionIndex = 0;
+	unsigned int artistsCount = 10, albumsCount = 10, tracksCount = 10;
+
+	// Look at the options
+	int optionChar = getopt_long(argc, argv, "a:b:ht:v", g_longOptions, &longOptionIndex);
+	while (optionChar != -1)
+	{
+		switch (optionChar)
+		{
+			case 'a':
+				if (optarg != NULL)
+				{
+					artistsCount = (unsigned int)atoi(optarg);
+				}
+				break;
+			case 'b':
+				if (optarg != NULL)
+				{
+					albumsCount = (unsigned int)atoi(optarg);
+				}
+				break;
+			case 'h':
+				print_help();
+				return EXIT_SUCCESS;
+			case 't':
+				if (optarg != NULL)
+				{
+					tracksCount = (unsigned int)atoi(optarg);
+				}
+				break;
+			case 'v':
+				clog << PACKAGE_STRING << endl;
+				return EXIT_SUCCESS;
+			default:
+				return EXIT_FAILURE;
+		}
+
+		// Next option
+		optionChar = getopt_long(argc, argv, "a:b:ht:v", g_longOptions, &longOptionIndex);
+	}
+
+	if (argc - optind != 1)
+	{
+		clog << "Wrong number of parameters, expected DIRECTORY" << endl;
+		return EXIT_FAILURE;
+	}
+
+	LibraryGenerator generator(argv[optind], artistsCount, albumsCount, tracksCount);
+
+	if (generator.generate() == false)
+	{
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}